@@ -1,12 +1,14 @@
 #include "devices/timer.h"
 #include <debug.h>
 #include <inttypes.h>
+#include <list.h>
 #include <round.h>
 #include <stdio.h>
 #include "threads/interrupt.h"
 #include "threads/io.h"
 #include "threads/synch.h"
 #include "threads/thread.h"
+#include "threads/tsc.h"
   
 /* See [8254] for hardware details of the 8254 timer chip. */
 
@@ -29,16 +31,65 @@ static bool too_many_loops (unsigned loops);
 static void busy_wait (int64_t loops);
 static void real_time_sleep (int64_t num, int32_t denom);
 
-
+/* Hierarchical timing wheel holding the pending alarms.
+
+   Level 0 has one bucket per tick for the next WHEEL_SIZE ticks.
+   Each bucket at level L covers WHEEL_SIZE**L ticks, so an alarm
+   is filed in O(1) by the distance to its expiry.  Whenever the
+   level-0 index wraps around, the current bucket of the next
+   level up is "cascaded", that is, its alarms are refiled at
+   lower levels.  Each timer interrupt thus only runs the one
+   level-0 bucket that is due, plus an occasional cascade.
+   Alarms further away than the wheel spans are parked in the
+   farthest top-level bucket and refiled when it cascades. */
+#define WHEEL_BITS 6                    /* Bits of index per level. */
+#define WHEEL_SIZE (1 << WHEEL_BITS)    /* Buckets per level. */
+#define WHEEL_MASK (WHEEL_SIZE - 1)
+#define WHEEL_LEVELS 4                  /* Spans 2**24 ticks. */
+static struct list wheel[WHEEL_LEVELS][WHEEL_SIZE];
+
+/* Next tick whose level-0 bucket has not yet been run. */
+static int64_t wheel_ticks;
+
+/* Longest time, in CPU cycles, that the timing wheel has kept
+   interrupts disabled. */
+static uint64_t wheel_max_cycles;
+
+static void wheel_insert (struct alarm *);
+static void wheel_advance (void);
+static void timer_run_tick (void);
+
+/* Tickless idle.
+
+   When only the idle thread can run, there is no point in taking
+   a timer interrupt on every tick.  Instead, just before it halts
+   the CPU, the idle thread reprograms the PIT for a single
+   interrupt at the first tick that has work to do: an alarm
+   expiring, a cascade of the timing wheel, or simply as far
+   ahead as the PIT's 16-bit counter reaches.  The skipped ticks
+   are not lost: when the one-shot interrupt arrives, or any
+   other external interrupt wakes the CPU earlier, the ticks that
+   have elapsed are replayed one by one, so timer_ticks() and
+   everything driven by thread_tick() see exactly what they would
+   have seen in periodic mode. */
+static uint16_t pit_period;     /* PIT input cycles per timer tick. */
+static int oneshot_ticks;       /* Tick boundaries spanned by the
+                                   one-shot count, or 0 if the PIT
+                                   is in periodic mode. */
+static uint16_t oneshot_count;  /* Initial one-shot count. */
+static uint16_t oneshot_first;  /* Cycles to its first boundary. */
+static int64_t skipped_ticks;   /* # of timer interrupts avoided. */
+
+static void pit_set_periodic (void);
+static void pit_set_oneshot (uint16_t count);
+static uint16_t pit_read (bool *out);
+
+/* A thread sleeping in timer_sleep(). */
 struct sleeper
-{
-    struct list_elem elem;
-    int64_t          end_tick;
-    struct semaphore sema;
-};
-
-static struct list sleepers;
-static struct lock sleepers_lock;
+  {
+    struct alarm alarm;                 /* Wakes up the thread. */
+    struct semaphore sema;              /* Upped by the alarm. */
+  };
 
 /* Sets up the 8254 Programmable Interval Timer (PIT) to
    interrupt PIT_FREQ times per second, and registers the
@@ -46,18 +97,18 @@ static struct lock sleepers_lock;
 void
 timer_init (void) 
 {
+  int level, i;
+
   /* 8254 input frequency divided by TIMER_FREQ, rounded to
      nearest. */
-  uint16_t count = (1193180 + TIMER_FREQ / 2) / TIMER_FREQ;
-
-  outb (0x43, 0x34);    /* CW: counter 0, LSB then MSB, mode 2, binary. */
-  outb (0x40, count & 0xff);
-  outb (0x40, count >> 8);
+  pit_period = (1193180 + TIMER_FREQ / 2) / TIMER_FREQ;
+  pit_set_periodic ();
 
   intr_register_ext (0x20, timer_interrupt, "8254 Timer");
 
-  list_init (&sleepers);
-  lock_init (&sleepers_lock);
+  for (level = 0; level < WHEEL_LEVELS; level++)
+    for (i = 0; i < WHEEL_SIZE; i++)
+      list_init (&wheel[level][i]);
 }
 
 /* Calibrates loops_per_tick, used to implement brief delays. */
@@ -106,14 +157,85 @@ timer_elapsed (int64_t then)
   return timer_ticks () - then;
 }
 
-static bool
-sleepers_less_func (const struct list_elem *a,
-                    const struct list_elem *b)
+/* Records that interrupts were kept off from cycle START until
+   now on behalf of the timing wheel. */
+static inline void
+account_cycles (uint64_t start) 
 {
-  struct sleeper *sa = list_entry (a, struct sleeper, elem);
-  struct sleeper *sb = list_entry (b, struct sleeper, elem);
+  uint64_t cycles = read_tsc () - start;
+  if (cycles > wheel_max_cycles)
+    wheel_max_cycles = cycles;
+}
 
-	return sa->end_tick < sb->end_tick ? true : false;
+/* Initializes ALARM to call FUNC, passing AUX, when it expires.
+   The alarm is not pending until alarm_set() is called. */
+void
+alarm_init (struct alarm *alarm, alarm_func *func, void *aux) 
+{
+  ASSERT (alarm != NULL);
+  ASSERT (func != NULL);
+
+  alarm->func = func;
+  alarm->aux = aux;
+  alarm->pending = false;
+}
+
+/* Arms ALARM to expire at the timer interrupt in which
+   timer_ticks() reaches EXPIRES.  If EXPIRES has already passed,
+   the alarm expires at the next timer interrupt.  ALARM's
+   function is called in an external interrupt context, so it
+   must not sleep.  ALARM must not already be pending.
+
+   Takes constant time, with interrupts disabled only briefly. */
+void
+alarm_set (struct alarm *alarm, int64_t expires) 
+{
+  enum intr_level old_level;
+  uint64_t start;
+
+  ASSERT (alarm != NULL);
+
+  old_level = intr_disable ();
+  start = read_tsc ();
+  ASSERT (!alarm->pending);
+  alarm->expires = expires;
+  alarm->pending = true;
+  wheel_insert (alarm);
+  account_cycles (start);
+  intr_set_level (old_level);
+}
+
+/* Cancels ALARM.  Returns true if it was pending, in which case
+   its function will not be called, or false if it had already
+   expired or was never set.
+
+   May be called from an interrupt handler. */
+bool
+alarm_cancel (struct alarm *alarm) 
+{
+  enum intr_level old_level;
+  bool was_pending;
+
+  ASSERT (alarm != NULL);
+
+  old_level = intr_disable ();
+  was_pending = alarm->pending;
+  if (was_pending)
+    {
+      list_remove (&alarm->elem);
+      alarm->pending = false;
+    }
+  intr_set_level (old_level);
+
+  return was_pending;
+}
+
+/* Alarm function for timer_sleep(). */
+static void
+wake_sleeper (void *sleeper_) 
+{
+  struct sleeper *sleeper = sleeper_;
+  sema_up (&sleeper->sema);
 }
 
 /* Suspends execution for approximately TICKS timer ticks. */
@@ -124,18 +246,12 @@ timer_sleep (int64_t ticks)
 
   ASSERT (intr_get_level () == INTR_ON);
 
-  s.end_tick = timer_ticks () + ticks;
-  sema_init (&s.sema, 0);
-
-  enum intr_level old_level = intr_disable ();
-  lock_acquire (&sleepers_lock);
-
-  list_insert_ordered (&sleepers, &s.elem, (list_less_func *)sleepers_less_func,
-                       NULL);
-
-  lock_release (&sleepers_lock);
-  intr_set_level (old_level);
+  if (ticks <= 0)
+    return;
 
+  sema_init (&s.sema, 0);
+  alarm_init (&s.alarm, wake_sleeper, &s);
+  alarm_set (&s.alarm, timer_ticks () + ticks);
   sema_down (&s.sema);
 }
 
@@ -160,34 +276,274 @@ timer_nsleep (int64_t ns)
   real_time_sleep (ns, 1000 * 1000 * 1000);
 }
 
+/* Called by the idle thread, with interrupts off, just before
+   it halts the CPU.  If no timer work is due at the next tick,
+   switches the PIT to a one-shot interrupt at the first tick that
+   has any. */
+void
+timer_tickless_enter (void) 
+{
+  int max_ticks = UINT16_MAX / pit_period;
+  int64_t t;
+  uint16_t first;
+  bool out;
+  int n;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (oneshot_ticks != 0)
+    return;
+
+  /* Find the first tick with work to do.  Cascades are only done
+     when the level-0 index wraps, so stop there too. */
+  for (n = 1; n < max_ticks; n++) 
+    {
+      t = ticks + n;
+      if (!list_empty (&wheel[0][t & WHEEL_MASK]) || (t & WHEEL_MASK) == 0)
+        break;
+    }
+  if (n <= 1)
+    return;
+
+  /* Count from the next tick boundary of the periodic timer, so
+     that the ticks stay in phase. */
+  first = pit_read (&out);
+  if (first == 0 || first > pit_period)
+    return;
+  oneshot_ticks = n;
+  oneshot_first = first;
+  oneshot_count = first + (n - 1) * pit_period;
+  pit_set_oneshot (oneshot_count);
+}
+
+/* Called at the start of every external interrupt.  If the PIT
+   is counting down a one-shot interrupt set up by
+   timer_tickless_enter(), replays the ticks that have elapsed so
+   far and arranges for the next timer interrupt to arrive at the
+   next tick boundary, after which the PIT returns to periodic
+   mode. */
+void
+timer_tickless_exit (void) 
+{
+  uint64_t start;
+  uint16_t count;
+  int elapsed;
+  bool out;
+
+  ASSERT (intr_context ());
+
+  if (oneshot_ticks <= 1)
+    return;
+
+  start = read_tsc ();
+  count = pit_read (&out);
+  if (out) 
+    {
+      /* The one-shot count has run out and the timer interrupt
+         is pending (or being handled).  It will run the final
+         tick itself. */
+      elapsed = oneshot_ticks - 1;
+      oneshot_ticks = 1;
+    }
+  else 
+    {
+      /* Woken early.  Interrupt again at the next boundary.  A
+         count of 0 would mean 65536 cycles to the PIT, so if the
+         boundary is right now, run its tick here and wait for the
+         one after it instead. */
+      int cycles = oneshot_count - count;
+      int remaining;
+
+      elapsed = (cycles < oneshot_first
+                 ? 0 : 1 + (cycles - oneshot_first) / pit_period);
+      remaining = count - (oneshot_ticks - elapsed - 1) * pit_period;
+      if (remaining <= 0)
+        {
+          elapsed++;
+          remaining += pit_period;
+        }
+      oneshot_ticks = 1;
+      oneshot_first = oneshot_count = remaining;
+      pit_set_oneshot (remaining);
+    }
+
+  skipped_ticks += elapsed;
+  while (elapsed-- > 0)
+    timer_run_tick ();
+  account_cycles (start);
+}
+
 /* Prints timer statistics. */
 void
 timer_print_stats (void) 
 {
-  printf ("Timer: %"PRId64" ticks\n", timer_ticks ());
+  printf ("Timer: %"PRId64" ticks, %"PRId64" skipped while idle\n",
+          timer_ticks (), skipped_ticks);
+}
+
+/* Returns the longest time, in CPU cycles, that the timing wheel
+   has kept interrupts disabled since the last call to
+   timer_reset_wheel_stats(). */
+uint64_t
+timer_wheel_max_cycles (void) 
+{
+  enum intr_level old_level = intr_disable ();
+  uint64_t cycles = wheel_max_cycles;
+  intr_set_level (old_level);
+  return cycles;
+}
+
+/* Resets the statistic returned by timer_wheel_max_cycles(). */
+void
+timer_reset_wheel_stats (void) 
+{
+  enum intr_level old_level = intr_disable ();
+  wheel_max_cycles = 0;
+  intr_set_level (old_level);
 }
 
 /* Timer interrupt handler. */
 static void
 timer_interrupt (struct intr_frame *args UNUSED)
+{
+  uint64_t start = read_tsc ();
+
+  if (oneshot_ticks != 0) 
+    {
+      /* timer_tickless_exit() has replayed all but this tick. */
+      ASSERT (oneshot_ticks == 1);
+      oneshot_ticks = 0;
+      pit_set_periodic ();
+    }
+  timer_run_tick ();
+  account_cycles (start);
+}
+
+/* Advances the tick count by one and does that tick's work. */
+static void
+timer_run_tick (void) 
 {
   ticks++;
   thread_tick ();
+  wheel_advance ();
+}
 
-  struct list_elem *e;
+/* Programs PIT counter 0 to interrupt every pit_period cycles. */
+static void
+pit_set_periodic (void) 
+{
+  outb (0x43, 0x34);    /* CW: counter 0, LSB then MSB, mode 2, binary. */
+  outb (0x40, pit_period & 0xff);
+  outb (0x40, pit_period >> 8);
+}
 
-  for (e = list_begin (&sleepers); e != list_end (&sleepers);)
-  {
-    struct sleeper *s = list_entry (e, struct sleeper, elem);
+/* Programs PIT counter 0 to interrupt once, COUNT cycles from
+   now. */
+static void
+pit_set_oneshot (uint16_t count) 
+{
+  outb (0x43, 0x30);    /* CW: counter 0, LSB then MSB, mode 0, binary. */
+  outb (0x40, count & 0xff);
+  outb (0x40, count >> 8);
+}
+
+/* Returns the current value of PIT counter 0 and stores the
+   state of its output pin in *OUT. */
+static uint16_t
+pit_read (bool *out) 
+{
+  uint8_t status, lsb, msb;
+
+  outb (0x43, 0xc2);    /* Read-back: latch count and status of counter 0. */
+  status = inb (0x40);
+  lsb = inb (0x40);
+  msb = inb (0x40);
+  *out = (status & 0x80) != 0;
+  return lsb | (msb << 8);
+}
 
-    if (ticks >= s->end_tick)
+/* Files pending ALARM in the bucket for its expiry time,
+   relative to wheel_ticks. */
+static void
+wheel_insert (struct alarm *alarm) 
+{
+  int64_t delta = alarm->expires - wheel_ticks;
+  int64_t expires = alarm->expires;
+  int level;
+
+  if (delta < 0)
+    {
+      /* Already due: run it with the next bucket. */
+      expires = wheel_ticks;
+      delta = 0;
+    }
+  else if (delta >= (int64_t) 1 << (WHEEL_BITS * WHEEL_LEVELS))
     {
-      e = list_remove (e);
-      sema_up (&s->sema);
+      /* Too far away: park it as far out as the wheel reaches. */
+      delta = ((int64_t) 1 << (WHEEL_BITS * WHEEL_LEVELS)) - 1;
+      expires = wheel_ticks + delta;
     }
-    else
+
+  for (level = 0; level < WHEEL_LEVELS - 1; level++)
+    if (delta < (int64_t) 1 << (WHEEL_BITS * (level + 1)))
       break;
-  }
+
+  list_push_back (&wheel[level][(expires >> (WHEEL_BITS * level))
+                                & WHEEL_MASK],
+                  &alarm->elem);
+}
+
+/* Refiles every alarm in BUCKET at lower levels. */
+static void
+wheel_cascade (struct list *bucket) 
+{
+  struct list pending;
+
+  list_init (&pending);
+  while (!list_empty (bucket))
+    list_push_back (&pending, list_pop_front (bucket));
+  while (!list_empty (&pending))
+    wheel_insert (list_entry (list_pop_front (&pending), struct alarm, elem));
+}
+
+/* Runs the level-0 buckets of every tick up to the current one,
+   cascading higher levels as their turn comes. */
+static void
+wheel_advance (void) 
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  while (wheel_ticks <= ticks) 
+    {
+      struct list *bucket = &wheel[0][wheel_ticks & WHEEL_MASK];
+      struct list due;
+      int level;
+
+      for (level = 1; level < WHEEL_LEVELS; level++) 
+        {
+          int64_t below = wheel_ticks >> (WHEEL_BITS * (level - 1));
+          if ((below & WHEEL_MASK) != 0)
+            break;
+          wheel_cascade (&wheel[level][(below >> WHEEL_BITS) & WHEEL_MASK]);
+        }
+
+      /* Take the bucket's alarms out and move on to the next
+         tick before running them, so that an alarm that re-arms
+         itself for a time that has passed is filed for the next
+         tick instead of running again in this loop. */
+      list_init (&due);
+      while (!list_empty (bucket))
+        list_push_back (&due, list_pop_front (bucket));
+      wheel_ticks++;
+
+      while (!list_empty (&due)) 
+        {
+          struct alarm *alarm = list_entry (list_pop_front (&due),
+                                            struct alarm, elem);
+          alarm->pending = false;
+          alarm->func (alarm->aux);
+        }
+    }
 }
 
 /* Returns true if LOOPS iterations waits for more than one timer
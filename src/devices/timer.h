@@ -1,12 +1,30 @@
 #ifndef DEVICES_TIMER_H
 #define DEVICES_TIMER_H
 
+#include <list.h>
 #include <round.h>
+#include <stdbool.h>
 #include <stdint.h>
 
 /* Number of timer interrupts per second. */
 #define TIMER_FREQ 100
 
+/* An alarm: calls a function from the timer interrupt handler
+   once a given tick is reached. */
+typedef void alarm_func (void *aux);
+struct alarm
+  {
+    struct list_elem elem;              /* Element in timing wheel. */
+    int64_t expires;                    /* Tick at which to expire. */
+    alarm_func *func;                   /* Function to call. */
+    void *aux;                          /* Argument to FUNC. */
+    bool pending;                       /* Set and not yet expired? */
+  };
+
+void alarm_init (struct alarm *, alarm_func *, void *aux);
+void alarm_set (struct alarm *, int64_t expires);
+bool alarm_cancel (struct alarm *);
+
 void timer_init (void);
 void timer_calibrate (void);
 
@@ -18,6 +36,11 @@ void timer_msleep (int64_t milliseconds);
 void timer_usleep (int64_t microseconds);
 void timer_nsleep (int64_t nanoseconds);
 
+void timer_tickless_enter (void);
+void timer_tickless_exit (void);
+
 void timer_print_stats (void);
+uint64_t timer_wheel_max_cycles (void);
+void timer_reset_wheel_stats (void);
 
 #endif /* devices/timer.h */
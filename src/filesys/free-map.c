@@ -9,6 +9,7 @@
 static struct file *free_map_file;   /* Free map file. */
 static struct bitmap *free_map;      /* Free map, one bit per disk sector. */
 static struct lock free_lock;        /* Lock protecting the free map */
+static size_t free_cursor;           /* Where the next allocation starts. */
 
 /* Initializes the free map. */
 void
@@ -24,7 +25,10 @@ free_map_init (void)
 }
 
 /* Allocates CNT consecutive sectors from the free map and stores
-   the first into *SECTORP.
+   the first into *SECTORP.  Allocation is next-fit, starting
+   after the sectors allocated last, so that sectors allocated in
+   sequence tend to be adjacent on disk and the scan need not
+   start over at the beginning of the map every time.
    Returns true if successful, false if all sectors were
    available. */
 bool
@@ -33,7 +37,8 @@ free_map_allocate (size_t cnt, disk_sector_t *sectorp)
   /* Take lock */
   lock_acquire (&free_lock);
 
-  disk_sector_t sector = bitmap_scan_and_flip (free_map, 0, cnt, false);
+  disk_sector_t sector = bitmap_scan_and_flip_next (free_map, &free_cursor,
+                                                      cnt, false);
   if (sector != BITMAP_ERROR
       && free_map_file != NULL
       && !bitmap_write (free_map, free_map_file))
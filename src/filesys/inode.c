@@ -6,6 +6,7 @@
 #include "filesys/filesys.h"
 #include "filesys/free-map.h"
 #include "threads/malloc.h"
+#include "threads/slab.h"
 #include "threads/synch.h"
 
 /* Identifies an inode. */
@@ -61,12 +62,32 @@ byte_to_sector (const struct inode *inode, off_t pos)
 static struct list open_inodes;
 static struct lock open_inodes_lock;
 
+/* Cache of struct inode. */
+static struct kmem_cache *inode_cache;
+
+static kmem_ctor inode_ctor;
+
 /* Initializes the inode module. */
 void
 inode_init (void) 
 {
   list_init (&open_inodes);
   lock_init (&open_inodes_lock);
+  inode_cache = kmem_cache_create ("inode", sizeof (struct inode),
+                                   inode_ctor);
+  if (inode_cache == NULL)
+    PANIC ("can't create inode cache");
+}
+
+/* Constructor for inode_cache.  An inode's rwlock is released
+   before the inode is freed, so it only needs to be initialized
+   once. */
+static void
+inode_ctor (void *inode_) 
+{
+  struct inode *inode = inode_;
+
+  rwlock_init (&inode->rw);
 }
 
 /* Initializes an inode with LENGTH bytes of data and
@@ -137,9 +158,12 @@ inode_open (disk_sector_t sector)
     }
 
   /* Allocate memory. */
-  inode = malloc (sizeof *inode);
-  if (inode == NULL)
-    return NULL;
+  inode = kmem_cache_alloc (inode_cache);
+  if (inode == NULL) 
+    {
+      lock_release (&open_inodes_lock);
+      return NULL;
+    }
 
   /* Initialize. */
   list_push_front (&open_inodes, &inode->elem);
@@ -147,7 +171,6 @@ inode_open (disk_sector_t sector)
   inode->open_cnt = 1;
   inode->deny_write_cnt = 0;
   inode->removed = false;
-  rwlock_init (&inode->rw);
   disk_read (filesys_disk, inode->sector, &inode->data);
 
   /* Release lock */
@@ -202,7 +225,7 @@ inode_close (struct inode *inode)
                             bytes_to_sectors (inode->data.length)); 
         }
 
-      free (inode); 
+      kmem_cache_free (inode_cache, inode);
     }
 
   /* Release lock */
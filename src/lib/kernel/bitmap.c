@@ -69,6 +69,66 @@ last_mask (const struct bitmap *b)
   return last_bits ? ((elem_type) 1 << last_bits) - 1 : (elem_type) -1;
 }
 
+/* Returns an elem_type in which bit K is set if bit K of ELEM
+   equals VALUE. */
+static inline elem_type
+match_bits (elem_type elem, bool value) 
+{
+  return value ? elem : ~elem;
+}
+
+/* Returns the number of 1-bits in ELEM.  Open-coded because the
+   kernel is not linked against libgcc, which is where
+   __builtin_popcountl() would end up on 80386. */
+static inline unsigned
+count_ones (elem_type elem) 
+{
+  elem = elem - ((elem >> 1) & 0x55555555);
+  elem = (elem & 0x33333333) + ((elem >> 2) & 0x33333333);
+  elem = (elem + (elem >> 4)) & 0x0f0f0f0f;
+  return (elem * 0x01010101) >> 24;
+}
+
+/* Returns a mask of the bits in element IDX that lie in bit
+   range [START, END). */
+static inline elem_type
+range_mask (size_t idx, size_t start, size_t end) 
+{
+  size_t first = idx * ELEM_BITS;
+  elem_type mask = (elem_type) -1;
+
+  if (start > first)
+    mask &= (elem_type) -1 << (start - first);
+  if (end < first + ELEM_BITS)
+    mask &= ((elem_type) 1 << (end - first)) - 1;
+  return mask;
+}
+
+/* Returns the index of the first bit at or after START and
+   before END in B that is set to VALUE, or END if there is none.
+   Examines a whole element at a time, using the BSF instruction
+   (see [IA32-v2a]) to locate the bit within an element. */
+static size_t
+find_bit (const struct bitmap *b, size_t start, size_t end, bool value) 
+{
+  size_t idx, last;
+
+  if (start >= end)
+    return end;
+
+  idx = elem_idx (start);
+  last = elem_idx (end - 1);
+  for (;;) 
+    {
+      elem_type bits = (match_bits (b->bits[idx], value)
+                        & range_mask (idx, start, end));
+      if (bits != 0)
+        return idx * ELEM_BITS + __builtin_ctzl (bits);
+      if (idx++ == last)
+        return end;
+    }
+}
+
 /* Creation and destruction. */
 
 /* Initializes B to be a bitmap of BIT_CNT bits
@@ -214,18 +274,32 @@ bitmap_set_all (struct bitmap *b, bool value)
   bitmap_set_multiple (b, 0, bitmap_size (b), value);
 }
 
-/* Sets the CNT bits starting at START in B to VALUE. */
+/* Sets the CNT bits starting at START in B to VALUE.
+   Each element is updated atomically, but the bits as a group
+   are not. */
 void
 bitmap_set_multiple (struct bitmap *b, size_t start, size_t cnt, bool value) 
 {
-  size_t i;
+  size_t idx, end;
   
   ASSERT (b != NULL);
   ASSERT (start <= b->bit_cnt);
   ASSERT (start + cnt <= b->bit_cnt);
 
-  for (i = 0; i < cnt; i++)
-    bitmap_set (b, start + i, value);
+  if (cnt == 0)
+    return;
+
+  end = start + cnt;
+  for (idx = elem_idx (start); idx <= elem_idx (end - 1); idx++) 
+    {
+      elem_type mask = range_mask (idx, start, end);
+
+      /* Atomic like bitmap_mark() and bitmap_reset(). */
+      if (value)
+        asm ("orl %1, %0" : "=m" (b->bits[idx]) : "r" (mask) : "cc");
+      else
+        asm ("andl %1, %0" : "=m" (b->bits[idx]) : "r" (~mask) : "cc");
+    }
 }
 
 /* Returns the number of bits in B between START and START + CNT,
@@ -233,16 +307,20 @@ bitmap_set_multiple (struct bitmap *b, size_t start, size_t cnt, bool value)
 size_t
 bitmap_count (const struct bitmap *b, size_t start, size_t cnt, bool value) 
 {
-  size_t i, value_cnt;
+  size_t idx, end, value_cnt;
 
   ASSERT (b != NULL);
   ASSERT (start <= b->bit_cnt);
   ASSERT (start + cnt <= b->bit_cnt);
 
+  if (cnt == 0)
+    return 0;
+
+  end = start + cnt;
   value_cnt = 0;
-  for (i = 0; i < cnt; i++)
-    if (bitmap_test (b, start + i) == value)
-      value_cnt++;
+  for (idx = elem_idx (start); idx <= elem_idx (end - 1); idx++)
+    value_cnt += count_ones (match_bits (b->bits[idx], value)
+                              & range_mask (idx, start, end));
   return value_cnt;
 }
 
@@ -251,16 +329,11 @@ bitmap_count (const struct bitmap *b, size_t start, size_t cnt, bool value)
 bool
 bitmap_contains (const struct bitmap *b, size_t start, size_t cnt, bool value) 
 {
-  size_t i;
-  
   ASSERT (b != NULL);
   ASSERT (start <= b->bit_cnt);
   ASSERT (start + cnt <= b->bit_cnt);
 
-  for (i = 0; i < cnt; i++)
-    if (bitmap_test (b, start + i) == value)
-      return true;
-  return false;
+  return find_bit (b, start, start + cnt, value) < start + cnt;
 }
 
 /* Returns true if any bits in B between START and START + CNT,
@@ -289,6 +362,34 @@ bitmap_all (const struct bitmap *b, size_t start, size_t cnt)
 
 /* Finding set or unset bits. */
 
+/* Finds and returns the starting index of the first group of CNT
+   consecutive bits in B at or after START and wholly before END
+   that are all set to VALUE, or BITMAP_ERROR if there is none.
+   Jumps from run to run: finds the next bit set to VALUE, then
+   the next one set to !VALUE after it, and checks whether the run
+   between them is long enough. */
+static size_t
+scan_range (const struct bitmap *b, size_t start, size_t end,
+            size_t cnt, bool value) 
+{
+  if (cnt == 0)
+    return start <= end ? start : BITMAP_ERROR;
+
+  while (start < end && end - start >= cnt) 
+    {
+      size_t run_end;
+
+      start = find_bit (b, start, end, value);
+      if (end - start < cnt)
+        break;
+      run_end = find_bit (b, start, start + cnt, !value);
+      if (run_end == start + cnt)
+        return start;
+      start = run_end;
+    }
+  return BITMAP_ERROR;
+}
+
 /* Finds and returns the starting index of the first group of CNT
    consecutive bits in B at or after START that are all set to
    VALUE.
@@ -299,15 +400,7 @@ bitmap_scan (const struct bitmap *b, size_t start, size_t cnt, bool value)
   ASSERT (b != NULL);
   ASSERT (start <= b->bit_cnt);
 
-  if (cnt <= b->bit_cnt) 
-    {
-      size_t last = b->bit_cnt - cnt;
-      size_t i;
-      for (i = start; i <= last; i++)
-        if (!bitmap_contains (b, i, cnt, !value))
-          return i; 
-    }
-  return BITMAP_ERROR;
+  return scan_range (b, start, b->bit_cnt, cnt, value);
 }
 
 /* Finds the first group of CNT consecutive bits in B at or after
@@ -325,6 +418,34 @@ bitmap_scan_and_flip (struct bitmap *b, size_t start, size_t cnt, bool value)
     bitmap_set_multiple (b, idx, cnt, !value);
   return idx;
 }
+
+/* Like bitmap_scan_and_flip(), but "next fit": the search starts
+   at *CURSOR and wraps around to the beginning of B, and *CURSOR
+   is advanced past the group found.  Successive calls thus hand
+   out groups in address order instead of rescanning the low
+   bits, which tend to fill up, every time.  *CURSOR should be
+   initialized to 0. */
+size_t
+bitmap_scan_and_flip_next (struct bitmap *b, size_t *cursor, size_t cnt,
+                           bool value) 
+{
+  size_t start, idx;
+
+  ASSERT (b != NULL);
+  ASSERT (cursor != NULL);
+
+  start = *cursor <= b->bit_cnt ? *cursor : 0;
+  idx = scan_range (b, start, b->bit_cnt, cnt, value);
+  if (idx == BITMAP_ERROR && start > 0)
+    idx = scan_range (b, 0, start + cnt - 1 < b->bit_cnt
+                            ? start + cnt - 1 : b->bit_cnt, cnt, value);
+  if (idx != BITMAP_ERROR) 
+    {
+      bitmap_set_multiple (b, idx, cnt, !value);
+      *cursor = idx + cnt;
+    }
+  return idx;
+}
 
 /* File input and output. */
 
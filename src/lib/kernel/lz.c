@@ -0,0 +1,192 @@
+#include "lz.h"
+#include <debug.h>
+#include <string.h>
+
+/* A sequence begins with a token byte.  Its high 4 bits are the
+   number of literal bytes and its low 4 bits the length of the
+   match minus MIN_MATCH.  A field of 15 continues in further
+   bytes, each added to it, until one is less than 255.  The
+   literals follow, and then, except in the last sequence, a
+   2-byte little-endian offset back from the current output
+   position to the start of the match, and the rest of the match
+   length. */
+
+/* Shortest match worth encoding. */
+#define MIN_MATCH 4
+
+/* Largest value that fits in a token field. */
+#define RUN_MASK 15
+
+static size_t length_bytes (size_t len);
+static uint8_t *put_length (uint8_t *, size_t len);
+static uint32_t read32 (const uint8_t *);
+static unsigned hash32 (uint32_t);
+
+/* Compresses the SRC_SIZE bytes at SRC into the DST_SIZE bytes
+   at DST, using TABLE as scratch space.  SRC_SIZE may be at most
+   65536, the range of the table's positions.  Returns the size
+   of the compressed data, or 0 if it would not fit in DST. */
+size_t
+lz_compress (const void *src_, size_t src_size,
+             void *dst_, size_t dst_size, struct lz_table *table)
+{
+  const uint8_t *src = src_;
+  const uint8_t *end = src + src_size;
+  const uint8_t *ip = src;
+  const uint8_t *anchor = src;
+  uint8_t *dst = dst_;
+  uint8_t *op = dst;
+  uint8_t *op_end = dst + dst_size;
+  size_t lit_len;
+
+  ASSERT (src_size <= 65536);
+
+  memset (table, 0, sizeof *table);
+  while (ip + MIN_MATCH <= end)
+    {
+      uint32_t seq = read32 (ip);
+      unsigned h = hash32 (seq);
+      const uint8_t *ref = src + table->pos[h];
+      size_t match_len;
+
+      table->pos[h] = ip - src;
+      if (ref >= ip || ip - ref > 0xffff || read32 (ref) != seq)
+        {
+          ip++;
+          continue;
+        }
+
+      match_len = MIN_MATCH;
+      while (ip + match_len < end && ref[match_len] == ip[match_len])
+        match_len++;
+
+      /* Emit the literals since the last match, then the match. */
+      lit_len = ip - anchor;
+      if (op + 1 + length_bytes (lit_len) + lit_len + 2
+          + length_bytes (match_len - MIN_MATCH) > op_end)
+        return 0;
+      *op++ = ((lit_len < RUN_MASK ? lit_len : RUN_MASK) << 4
+               | (match_len - MIN_MATCH < RUN_MASK
+                  ? match_len - MIN_MATCH : RUN_MASK));
+      op = put_length (op, lit_len);
+      memcpy (op, anchor, lit_len);
+      op += lit_len;
+      *op++ = (ip - ref) & 0xff;
+      *op++ = (ip - ref) >> 8;
+      op = put_length (op, match_len - MIN_MATCH);
+
+      ip += match_len;
+      anchor = ip;
+    }
+
+  /* The last sequence has only literals. */
+  lit_len = end - anchor;
+  if (op + 1 + length_bytes (lit_len) + lit_len > op_end)
+    return 0;
+  *op++ = (lit_len < RUN_MASK ? lit_len : RUN_MASK) << 4;
+  op = put_length (op, lit_len);
+  memcpy (op, anchor, lit_len);
+  op += lit_len;
+
+  return op - dst;
+}
+
+/* Decompresses the SRC_SIZE bytes at SRC, produced by
+   lz_compress(), into the DST_SIZE bytes at DST.  Returns true
+   if successful, false if SRC is malformed or does not
+   decompress to exactly DST_SIZE bytes. */
+bool
+lz_decompress (const void *src_, size_t src_size,
+               void *dst_, size_t dst_size)
+{
+  const uint8_t *ip = src_;
+  const uint8_t *ip_end = ip + src_size;
+  uint8_t *dst = dst_;
+  uint8_t *op = dst;
+  uint8_t *op_end = dst + dst_size;
+
+  while (ip < ip_end)
+    {
+      unsigned token = *ip++;
+      size_t len = token >> 4;
+      const uint8_t *ref;
+
+      /* Literals. */
+      if (len == RUN_MASK)
+        do
+          {
+            if (ip >= ip_end)
+              return false;
+            len += *ip;
+          }
+        while (*ip++ == 255);
+      if ((size_t) (ip_end - ip) < len || (size_t) (op_end - op) < len)
+        return false;
+      memcpy (op, ip, len);
+      op += len;
+      ip += len;
+      if (ip == ip_end)
+        break;
+
+      /* Match. */
+      if (ip_end - ip < 2)
+        return false;
+      ref = op - (ip[0] | (ip[1] << 8));
+      ip += 2;
+      len = token & RUN_MASK;
+      if (len == RUN_MASK)
+        do
+          {
+            if (ip >= ip_end)
+              return false;
+            len += *ip;
+          }
+        while (*ip++ == 255);
+      len += MIN_MATCH;
+      if (ref < dst || ref >= op || (size_t) (op_end - op) < len)
+        return false;
+
+      /* The match may overlap its own output, so copy bytewise. */
+      while (len-- > 0)
+        *op++ = *ref++;
+    }
+  return op == op_end;
+}
+
+/* Returns the number of extra bytes needed to encode length LEN
+   in a sequence after its token field. */
+static size_t
+length_bytes (size_t len)
+{
+  return len < RUN_MASK ? 0 : (len - RUN_MASK) / 255 + 1;
+}
+
+/* Writes the extra bytes for length LEN, if any, at OP and
+   returns the position just past them. */
+static uint8_t *
+put_length (uint8_t *op, size_t len)
+{
+  if (len >= RUN_MASK)
+    {
+      for (len -= RUN_MASK; len >= 255; len -= 255)
+        *op++ = 255;
+      *op++ = len;
+    }
+  return op;
+}
+
+/* Returns the 4 bytes at P as a 32-bit integer. */
+static uint32_t
+read32 (const uint8_t *p)
+{
+  uint32_t x;
+  memcpy (&x, p, sizeof x);
+  return x;
+}
+
+/* Returns a hash table index for the 4 bytes X. */
+static unsigned
+hash32 (uint32_t x)
+{
+  return (x * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
@@ -0,0 +1,31 @@
+#ifndef __LIB_KERNEL_LZ_H
+#define __LIB_KERNEL_LZ_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Fast LZ77 compression of small buffers, such as pages.
+
+   The compressed data is a series of sequences, each a run of
+   literal bytes followed by a copy of earlier output, in the
+   format of an LZ4 block.  Matches are found through a hash table
+   of recent positions, which the caller supplies so that nothing
+   large has to live on the kernel stack. */
+
+/* Number of entries in the hash table that lz_compress() uses. */
+#define LZ_HASH_BITS 12
+#define LZ_HASH_SIZE (1u << LZ_HASH_BITS)
+
+/* Hash table for lz_compress(). */
+struct lz_table
+  {
+    uint16_t pos[LZ_HASH_SIZE];
+  };
+
+size_t lz_compress (const void *src, size_t src_size,
+                    void *dst, size_t dst_size, struct lz_table *);
+bool lz_decompress (const void *src, size_t src_size,
+                    void *dst, size_t dst_size);
+
+#endif /* lib/kernel/lz.h */
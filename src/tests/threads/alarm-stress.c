@@ -0,0 +1,167 @@
+/* Arms a few thousand alarms with random expiry times, cancels
+   some of them, and runs several threads that call timer_sleep()
+   concurrently.  Verifies that every remaining alarm expires on
+   exactly its tick, that no canceled alarm expires, and that no
+   sleeper wakes up early.  Also reports the longest stretch for
+   which the timing wheel kept interrupts disabled. */
+
+#include <inttypes.h>
+#include <random.h>
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/interrupt.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+#define ALARM_CNT 3000          /* Number of alarms. */
+#define CANCEL_EVERY 7          /* Cancel every Nth alarm. */
+#define MAX_DELAY 500           /* Maximum alarm delay in ticks. */
+#define SLEEPER_CNT 8           /* Number of sleeping threads. */
+#define SLEEP_ITERATIONS 20     /* Sleeps per sleeping thread. */
+
+/* One alarm in the test. */
+struct stress_alarm
+  {
+    struct alarm alarm;         /* The alarm. */
+    int64_t expires;            /* Tick at which it should expire. */
+    int64_t fired;              /* Tick at which it expired, or -1. */
+  };
+
+/* State shared by the whole test. */
+struct stress_test
+  {
+    int pending;                /* Alarms not yet expired. */
+    struct semaphore done;      /* Upped when PENDING reaches 0. */
+    struct semaphore sleepers;  /* Upped by each finished sleeper. */
+    int early_wakeups;          /* Sleeps that returned too soon. */
+  };
+
+static struct stress_test test;
+
+static alarm_func stress_alarm_expired;
+static thread_func sleeper;
+
+void
+test_alarm_stress (void)
+{
+  struct stress_alarm *alarms;
+  int late, early, missing;
+  int64_t start;
+  int i;
+
+  msg ("Arming %d alarms, canceling every %dth.", ALARM_CNT, CANCEL_EVERY);
+  msg ("Starting %d threads to sleep %d times each.",
+       SLEEPER_CNT, SLEEP_ITERATIONS);
+
+  alarms = malloc (sizeof *alarms * ALARM_CNT);
+  if (alarms == NULL)
+    PANIC ("couldn't allocate memory for test");
+
+  test.pending = ALARM_CNT;
+  test.early_wakeups = 0;
+  sema_init (&test.done, 0);
+  sema_init (&test.sleepers, 0);
+  timer_reset_wheel_stats ();
+
+  for (i = 0; i < SLEEPER_CNT; i++)
+    {
+      char name[16];
+      snprintf (name, sizeof name, "sleeper %d", i);
+      thread_create (name, PRI_DEFAULT, sleeper, &test);
+    }
+
+  /* Arm the alarms. */
+  start = timer_ticks ();
+  for (i = 0; i < ALARM_CNT; i++)
+    {
+      struct stress_alarm *a = &alarms[i];
+
+      a->expires = start + 1 + random_ulong () % MAX_DELAY;
+      a->fired = -1;
+      alarm_init (&a->alarm, stress_alarm_expired, a);
+      alarm_set (&a->alarm, a->expires);
+    }
+
+  /* Cancel some of them.  The pending count is only changed with
+     interrupts off, because the alarm functions run in the timer
+     interrupt handler. */
+  for (i = 0; i < ALARM_CNT; i += CANCEL_EVERY)
+    {
+      enum intr_level old_level = intr_disable ();
+      if (alarm_cancel (&alarms[i].alarm) && --test.pending == 0)
+        sema_up (&test.done);
+      intr_set_level (old_level);
+    }
+
+  /* Wait for everything to finish. */
+  sema_down (&test.done);
+  for (i = 0; i < SLEEPER_CNT; i++)
+    sema_down (&test.sleepers);
+
+  /* Check the results. */
+  late = early = missing = 0;
+  for (i = 0; i < ALARM_CNT; i++)
+    {
+      struct stress_alarm *a = &alarms[i];
+      if (i % CANCEL_EVERY == 0 && a->fired < 0)
+        continue;
+      if (a->fired < 0)
+        missing++;
+      else if (a->fired < a->expires)
+        early++;
+      else if (a->fired > a->expires)
+        late++;
+    }
+  free (alarms);
+
+  if (early > 0)
+    fail ("%d alarms expired early", early);
+  if (late > 0)
+    fail ("%d alarms expired late", late);
+  if (missing > 0)
+    fail ("%d alarms never expired", missing);
+  if (test.early_wakeups > 0)
+    fail ("%d sleeps returned early", test.early_wakeups);
+  msg ("All alarms expired on time.");
+  msg ("All sleepers woke up on time.");
+  msg ("Longest interrupts-off stretch in timing wheel: %"PRIu64" cycles.",
+       timer_wheel_max_cycles ());
+  pass ();
+}
+
+/* Alarm function: records the tick at which alarm A expired. */
+static void
+stress_alarm_expired (void *a_)
+{
+  struct stress_alarm *a = a_;
+
+  a->fired = timer_ticks ();
+  if (--test.pending == 0)
+    sema_up (&test.done);
+}
+
+/* Sleeper thread. */
+static void
+sleeper (void *test_)
+{
+  struct stress_test *t = test_;
+  int i;
+
+  for (i = 0; i < SLEEP_ITERATIONS; i++)
+    {
+      int64_t duration = 1 + random_ulong () % 20;
+      int64_t start = timer_ticks ();
+
+      timer_sleep (duration);
+      if (timer_elapsed (start) < duration)
+        {
+          enum intr_level old_level = intr_disable ();
+          t->early_wakeups++;
+          intr_set_level (old_level);
+        }
+    }
+  sema_up (&t->sleepers);
+}
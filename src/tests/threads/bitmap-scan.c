@@ -0,0 +1,191 @@
+/* Checks bitmap_scan(), bitmap_count(), and bitmap_contains()
+   against straightforward bit-at-a-time versions on random
+   bitmaps, checks that bitmap_scan_and_flip_next() hands out
+   groups in address order and wraps around, and reports how many
+   CPU cycles each scan takes. */
+
+#include <bitmap.h>
+#include <inttypes.h>
+#include <random.h>
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/tsc.h"
+
+/* Number of bits in the bitmaps that we will test. */
+#define BIT_CNT 4096
+
+/* Number of scans to time per density. */
+#define SCAN_CNT 1000
+
+static void randomize (struct bitmap *, int density);
+static size_t slow_scan (const struct bitmap *, size_t start, size_t cnt,
+                         bool value);
+static size_t slow_count (const struct bitmap *, size_t start, size_t cnt,
+                          bool value);
+static void verify (const struct bitmap *);
+static void benchmark (struct bitmap *, int density);
+static void test_next_fit (struct bitmap *);
+
+void
+test_bitmap_scan (void) 
+{
+  struct bitmap *b = bitmap_create (BIT_CNT);
+  int density;
+
+  if (b == NULL)
+    fail ("bitmap_create failed");
+
+  for (density = 0; density <= 100; density += 5) 
+    {
+      int repeat;
+
+      for (repeat = 0; repeat < 10; repeat++) 
+        {
+          randomize (b, density);
+          verify (b);
+        }
+    }
+  msg ("Scans agree with bit-at-a-time versions.");
+
+  test_next_fit (b);
+  msg ("Next-fit allocation wraps around.");
+
+  for (density = 50; density <= 100; density += 10)
+    benchmark (b, density);
+
+  bitmap_destroy (b);
+  pass ();
+}
+
+/* Sets about DENSITY percent of the bits in B, at random. */
+static void
+randomize (struct bitmap *b, int density) 
+{
+  size_t i;
+
+  for (i = 0; i < bitmap_size (b); i++)
+    bitmap_set (b, i, (int) (random_ulong () % 100) < density);
+}
+
+/* Original implementation of bitmap_scan(): tries every starting
+   position and tests every bit. */
+static size_t
+slow_scan (const struct bitmap *b, size_t start, size_t cnt, bool value) 
+{
+  if (cnt <= bitmap_size (b)) 
+    {
+      size_t last = bitmap_size (b) - cnt;
+      size_t i, j;
+
+      for (i = start; i <= last; i++) 
+        {
+          for (j = 0; j < cnt; j++)
+            if (bitmap_test (b, i + j) != value)
+              break;
+          if (j == cnt)
+            return i;
+        }
+    }
+  return BITMAP_ERROR;
+}
+
+/* Counts the bits set to VALUE one at a time. */
+static size_t
+slow_count (const struct bitmap *b, size_t start, size_t cnt, bool value) 
+{
+  size_t i, value_cnt = 0;
+
+  for (i = 0; i < cnt; i++)
+    if (bitmap_test (b, start + i) == value)
+      value_cnt++;
+  return value_cnt;
+}
+
+/* Compares the word-at-a-time functions against the
+   bit-at-a-time ones on B. */
+static void
+verify (const struct bitmap *b) 
+{
+  int i;
+
+  for (i = 0; i < 64; i++) 
+    {
+      size_t start = random_ulong () % (BIT_CNT + 1);
+      size_t cnt = random_ulong () % (BIT_CNT - start + 1) % 100;
+      bool value = random_ulong () % 2;
+      size_t value_cnt = slow_count (b, start, cnt, value);
+
+      if (bitmap_scan (b, start, cnt, value)
+          != slow_scan (b, start, cnt, value))
+        fail ("bitmap_scan (%zu, %zu, %d) disagrees", start, cnt, value);
+      if (bitmap_count (b, start, cnt, value) != value_cnt)
+        fail ("bitmap_count (%zu, %zu, %d) disagrees", start, cnt, value);
+      if (bitmap_contains (b, start, cnt, value) != (value_cnt > 0))
+        fail ("bitmap_contains (%zu, %zu, %d) disagrees",
+              start, cnt, value);
+    }
+}
+
+/* Allocates groups from B with bitmap_scan_and_flip_next() until
+   it is full, checking that they come out in address order, then
+   frees one group and checks that the cursor wraps around to
+   find it. */
+static void
+test_next_fit (struct bitmap *b) 
+{
+  size_t cursor = 0;
+  size_t last = 0;
+  size_t idx;
+
+  bitmap_set_all (b, false);
+  while ((idx = bitmap_scan_and_flip_next (b, &cursor, 3, false))
+         != BITMAP_ERROR) 
+    {
+      if (idx != last || cursor != idx + 3)
+        fail ("next fit returned %zu with cursor %zu, expected %zu",
+              idx, cursor, last);
+      last = idx + 3;
+    }
+  if (last != BIT_CNT / 3 * 3)
+    fail ("next fit stopped at %zu", last);
+
+  bitmap_set_multiple (b, 30, 3, false);
+  idx = bitmap_scan_and_flip_next (b, &cursor, 3, false);
+  if (idx != 30 || cursor != 33)
+    fail ("next fit did not wrap around: got %zu with cursor %zu",
+          idx, cursor);
+  if (bitmap_scan_and_flip_next (b, &cursor, 3, false) != BITMAP_ERROR)
+    fail ("next fit allocated from a full bitmap");
+}
+
+/* Times the old and new scans for runs of free bits in B with
+   about DENSITY percent of its bits set, and prints the average
+   cycles per scan. */
+static void
+benchmark (struct bitmap *b, int density) 
+{
+  uint64_t slow_cycles = 0, fast_cycles = 0;
+  int i;
+
+  randomize (b, density);
+  for (i = 0; i < SCAN_CNT; i++) 
+    {
+      size_t cnt = 1 + random_ulong () % 4;
+      size_t slow_idx, fast_idx;
+      uint64_t start;
+
+      start = read_tsc ();
+      slow_idx = slow_scan (b, 0, cnt, false);
+      slow_cycles += read_tsc () - start;
+
+      start = read_tsc ();
+      fast_idx = bitmap_scan (b, 0, cnt, false);
+      fast_cycles += read_tsc () - start;
+
+      if (slow_idx != fast_idx)
+        fail ("bitmap_scan returned %zu, expected %zu", fast_idx, slow_idx);
+    }
+  msg ("%d%% full: bit-at-a-time %"PRIu64" cycles/scan, "
+       "word-at-a-time %"PRIu64" cycles/scan", density,
+       slow_cycles / SCAN_CNT, fast_cycles / SCAN_CNT);
+}
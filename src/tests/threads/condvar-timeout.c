@@ -0,0 +1,84 @@
+/* Tests cond_wait_timeout(), both when the wait times out and
+   when the condition is signaled first, and checks that threads
+   released by cond_broadcast() come back one at a time, each
+   holding the lock. */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+#define WAITER_CNT 5
+
+static thread_func signaler_thread;
+static thread_func waiter_thread;
+static struct lock lock;
+static struct condition condition;
+static int inside;              /* Waiters between wakeup and release. */
+
+void
+test_condvar_timeout (void) 
+{
+  int64_t start;
+  int i;
+
+  lock_init (&lock);
+  cond_init (&condition);
+
+  /* Nobody signals: the wait must time out. */
+  lock_acquire (&lock);
+  start = timer_ticks ();
+  if (cond_wait_timeout (&condition, &lock, 10))
+    fail ("unsignaled wait reported a signal");
+  if (timer_elapsed (start) < 10)
+    fail ("wait timed out after only %"PRId64" ticks", timer_elapsed (start));
+  if (!lock_held_by_current_thread (&lock))
+    fail ("lock not held after timeout");
+  msg ("Wait timed out.");
+
+  /* Another thread signals before the timeout. */
+  thread_create ("signaler", PRI_DEFAULT, signaler_thread, NULL);
+  if (!cond_wait_timeout (&condition, &lock, 1000))
+    fail ("signaled wait timed out");
+  msg ("Wait was signaled.");
+  lock_release (&lock);
+
+  /* Broadcast to several waiters at higher priority. */
+  inside = 0;
+  for (i = 0; i < WAITER_CNT; i++) 
+    {
+      char name[16];
+      snprintf (name, sizeof name, "waiter %d", i);
+      thread_create (name, PRI_DEFAULT + 1, waiter_thread, NULL);
+    }
+  lock_acquire (&lock);
+  msg ("Broadcasting...");
+  cond_broadcast (&condition, &lock);
+  lock_release (&lock);
+  msg ("All waiters done.");
+}
+
+static void
+signaler_thread (void *aux UNUSED) 
+{
+  timer_sleep (5);
+  lock_acquire (&lock);
+  cond_signal (&condition, &lock);
+  lock_release (&lock);
+}
+
+static void
+waiter_thread (void *aux UNUSED) 
+{
+  lock_acquire (&lock);
+  cond_wait (&condition, &lock);
+  if (!lock_held_by_current_thread (&lock) || inside++ != 0)
+    fail ("%s woke up without exclusive use of the lock", thread_name ());
+  msg ("Thread %s woke up.", thread_name ());
+  inside--;
+  lock_release (&lock);
+}
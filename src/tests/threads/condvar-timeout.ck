@@ -0,0 +1,18 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(condvar-timeout) begin
+(condvar-timeout) Wait timed out.
+(condvar-timeout) Wait was signaled.
+(condvar-timeout) Broadcasting...
+(condvar-timeout) Thread waiter 0 woke up.
+(condvar-timeout) Thread waiter 1 woke up.
+(condvar-timeout) Thread waiter 2 woke up.
+(condvar-timeout) Thread waiter 3 woke up.
+(condvar-timeout) Thread waiter 4 woke up.
+(condvar-timeout) All waiters done.
+(condvar-timeout) end
+EOF
+pass;
@@ -0,0 +1,117 @@
+/* Measures the cost of a context switch between two kernel
+   threads that take turns on a pair of semaphores.
+
+   Then measures the TLB cost of switching page directories by
+   reloading CR3 and touching a few kernel pages, with the
+   kernel's mappings global, as paging_init() makes them if the
+   CPU supports it, with them not global, and without the reload,
+   as pagedir_activate() now does when the page directory does
+   not change. */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/cpu.h"
+#include "threads/init.h"
+#include "threads/interrupt.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/tsc.h"
+#include "threads/vaddr.h"
+
+#define SWITCH_ROUNDS 1000      /* Round trips between threads. */
+#define RELOAD_ROUNDS 1000      /* CR3 reloads per measurement. */
+#define TOUCH_PAGES 64          /* Pages touched after each reload. */
+
+/* Semaphores that the two threads take turns on. */
+struct ping_pong
+  {
+    struct semaphore ping;
+    struct semaphore pong;
+  };
+
+static thread_func ponger;
+static uint64_t time_touches (const uint8_t *pages, bool reload);
+
+void
+test_context_switch (void)
+{
+  struct ping_pong pp;
+  uint8_t *pages;
+  uint64_t start, cycles;
+  enum intr_level old_level;
+  int i;
+
+  /* Ping-pong between this thread and another one. */
+  sema_init (&pp.ping, 0);
+  sema_init (&pp.pong, 0);
+  thread_create ("ponger", PRI_DEFAULT, ponger, &pp);
+  start = read_tsc ();
+  for (i = 0; i < SWITCH_ROUNDS; i++) 
+    {
+      sema_up (&pp.ping);
+      sema_down (&pp.pong);
+    }
+  cycles = read_tsc () - start;
+  msg ("Context switch: %"PRIu64" cycles.", cycles / (2 * SWITCH_ROUNDS));
+
+  /* Reload CR3 and touch pages. */
+  pages = palloc_get_multiple (PAL_ASSERT | PAL_ZERO, TOUCH_PAGES);
+  old_level = intr_disable ();
+  msg ("Touching %d pages without reload: %"PRIu64" cycles.",
+       TOUCH_PAGES, time_touches (pages, false));
+  if (cpu_has (CPUID_PGE) && (cr4_read () & CR4_PGE)) 
+    {
+      uint32_t cr4 = cr4_read ();
+
+      msg ("Touching %d pages after reload, global: %"PRIu64" cycles.",
+           TOUCH_PAGES, time_touches (pages, true));
+      cr4_write (cr4 & ~CR4_PGE);
+      msg ("Touching %d pages after reload, not global: %"PRIu64" cycles.",
+           TOUCH_PAGES, time_touches (pages, true));
+      cr4_write (cr4);
+    }
+  else
+    msg ("Touching %d pages after reload: %"PRIu64" cycles "
+         "(no global pages).", TOUCH_PAGES, time_touches (pages, true));
+  intr_set_level (old_level);
+  palloc_free_multiple (pages, TOUCH_PAGES);
+
+  pass ();
+}
+
+/* The other half of the ping-pong. */
+static void
+ponger (void *pp_) 
+{
+  struct ping_pong *pp = pp_;
+  int i;
+
+  for (i = 0; i < SWITCH_ROUNDS; i++) 
+    {
+      sema_down (&pp->ping);
+      sema_up (&pp->pong);
+    }
+}
+
+/* Returns the average number of cycles taken to read a byte from
+   each of the TOUCH_PAGES pages starting at PAGES, after
+   reloading CR3 first if RELOAD is true. */
+static uint64_t
+time_touches (const uint8_t *pages, bool reload) 
+{
+  volatile const uint8_t *p = pages;
+  uint64_t start;
+  int i, j;
+
+  start = read_tsc ();
+  for (i = 0; i < RELOAD_ROUNDS; i++) 
+    {
+      if (reload)
+        cr3_write (cr3_read ());
+      for (j = 0; j < TOUCH_PAGES; j++)
+        p[j * PGSIZE];
+    }
+  return (read_tsc () - start) / RELOAD_ROUNDS;
+}
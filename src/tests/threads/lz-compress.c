@@ -0,0 +1,111 @@
+/* Compresses and decompresses pages of zeros, of random bytes,
+   of short repeating patterns, and of text-like data with many
+   short matches, and checks that every page comes back intact,
+   that compressible pages actually shrink, and that compressing
+   into too small a buffer fails cleanly. */
+
+#include <lz.h>
+#include <random.h>
+#include <stdio.h>
+#include <string.h>
+#include "tests/threads/tests.h"
+
+/* Size of the buffers compressed. */
+#define BUF_SIZE 4096
+
+/* Number of buffers of each kind. */
+#define REPEAT 64
+
+static void fill (uint8_t *, int kind);
+static size_t round_trip (const uint8_t *, size_t dst_size);
+
+void
+test_lz_compress (void)
+{
+  static const char *kinds[] = {"zeros", "random", "pattern", "text"};
+  static uint8_t buf[BUF_SIZE];
+  int kind, repeat;
+
+  for (kind = 0; kind < 4; kind++)
+    {
+      for (repeat = 0; repeat < REPEAT; repeat++)
+        {
+          size_t size;
+
+          fill (buf, kind);
+          size = round_trip (buf, BUF_SIZE);
+          if (kind != 1 && (size == 0 || size >= BUF_SIZE * 3 / 4))
+            fail ("%s page compressed to %zu bytes", kinds[kind], size);
+
+          /* A destination too small must fail cleanly. */
+          if (size > 1 && round_trip (buf, size - 1) != 0)
+            fail ("%s page fit in %zu bytes, less than its "
+                  "compressed size", kinds[kind], size - 1);
+        }
+      msg ("%s pages round-trip.", kinds[kind]);
+    }
+  pass ();
+}
+
+/* Fills BUF with data of the given KIND: 0 for zeros, 1 for
+   random bytes, 2 for a short repeating pattern, 3 for text made
+   of randomly chosen words. */
+static void
+fill (uint8_t *buf, int kind)
+{
+  static const char *words[] =
+    {
+      "page ", "frame ", "swap ", "disk ", "sector ", "inode ",
+      "thread ", "lock ", "the ", "of ", "and ", "is ",
+    };
+  size_t period = random_ulong () % 37 + 1;
+  size_t i;
+
+  for (i = 0; i < BUF_SIZE; )
+    switch (kind)
+      {
+      case 0:
+        buf[i++] = 0;
+        break;
+      case 1:
+        buf[i++] = random_ulong ();
+        break;
+      case 2:
+        buf[i] = i % period;
+        i++;
+        break;
+      default:
+        {
+          const char *w = words[random_ulong () % (sizeof words
+                                                   / sizeof *words)];
+          while (*w != '\0' && i < BUF_SIZE)
+            buf[i++] = *w++;
+        }
+        break;
+      }
+}
+
+/* Compresses SRC into a buffer of DST_SIZE bytes and, if it
+   fits, checks that it decompresses to SRC.  Returns the
+   compressed size, or 0 if it did not fit. */
+static size_t
+round_trip (const uint8_t *src, size_t dst_size)
+{
+  static struct lz_table table;
+  static uint8_t compressed[BUF_SIZE];
+  static uint8_t out[BUF_SIZE];
+  size_t size;
+
+  size = lz_compress (src, BUF_SIZE, compressed, dst_size, &table);
+  if (size == 0)
+    return 0;
+  if (size > dst_size)
+    fail ("compressed %zu bytes into a %zu-byte buffer", size, dst_size);
+
+  memset (out, 0xcc, sizeof out);
+  if (!lz_decompress (compressed, size, out, BUF_SIZE))
+    fail ("decompression failed");
+  if (memcmp (src, out, BUF_SIZE))
+    fail ("decompressed page differs from original");
+  return size;
+}
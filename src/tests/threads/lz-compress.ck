@@ -0,0 +1,14 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(lz-compress) begin
+(lz-compress) zeros pages round-trip.
+(lz-compress) random pages round-trip.
+(lz-compress) pattern pages round-trip.
+(lz-compress) text pages round-trip.
+(lz-compress) PASS
+(lz-compress) end
+EOF
+pass;
@@ -0,0 +1,191 @@
+/* Runs the same random workload of multi-page allocations and
+   frees against the page allocator's user pool and against a
+   bitmap managed the way the old first-fit page allocator did,
+   and reports the cycles per operation of each along with how
+   fragmented each leaves its memory.  Also checks that freeing
+   everything coalesces the pool back to where it started. */
+
+#include <bitmap.h>
+#include <inttypes.h>
+#include <random.h>
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/tsc.h"
+#include "threads/vaddr.h"
+
+#define SLOT_CNT 64             /* Live allocations at most. */
+#define OP_CNT 4000             /* Allocations and frees. */
+#define MAX_PAGES 8             /* Largest allocation, in pages. */
+#define SEED 0x5eed             /* Seed for the workload. */
+#define MAX_POOL_PAGES 8192     /* Most user pool pages counted. */
+
+/* An allocator under test. */
+struct allocator
+  {
+    const char *name;
+    size_t (*alloc) (size_t page_cnt);  /* Returns BITMAP_ERROR on failure. */
+    void (*free) (size_t page_idx, size_t page_cnt);
+  };
+
+/* Results of one run of the workload. */
+struct result
+  {
+    uint64_t cycles;            /* Total cycles in alloc and free. */
+    int failures;               /* Failed allocations. */
+    size_t largest;             /* Largest block free at the end. */
+  };
+
+static size_t pool_pages;       /* Pages in the user pool. */
+static uint8_t *pool_base;      /* Lowest user pool page seen. */
+static struct bitmap *old_map;  /* Stands in for the old allocator. */
+
+static size_t palloc_alloc (size_t);
+static void palloc_free (size_t, size_t);
+static size_t bitmap_alloc (size_t);
+static void bitmap_free (size_t, size_t);
+static size_t largest_block (const struct allocator *);
+static void run (const struct allocator *, struct result *);
+
+void
+test_palloc_buddy (void) 
+{
+  static const struct allocator buddy = {"buddy", palloc_alloc, palloc_free};
+  static const struct allocator first_fit = {"first-fit bitmap",
+                                             bitmap_alloc, bitmap_free};
+  const struct allocator *allocators[] = {&buddy, &first_fit};
+  size_t start_largest;
+  void **pages;
+  int i;
+
+  /* Count the user pool's pages by allocating all of them. */
+  pages = malloc (sizeof *pages * MAX_POOL_PAGES);
+  if (pages == NULL)
+    PANIC ("couldn't allocate memory for test");
+  pool_base = NULL;
+  for (pool_pages = 0; pool_pages < MAX_POOL_PAGES; pool_pages++) 
+    {
+      pages[pool_pages] = palloc_get_page (PAL_USER);
+      if (pages[pool_pages] == NULL)
+        break;
+      if (pool_base == NULL || (uint8_t *) pages[pool_pages] < pool_base)
+        pool_base = pages[pool_pages];
+    }
+  for (i = 0; (size_t) i < pool_pages; i++)
+    palloc_free_page (pages[i]);
+  free (pages);
+  msg ("User pool has %zu pages.", pool_pages);
+
+  old_map = bitmap_create (pool_pages);
+  if (old_map == NULL)
+    PANIC ("couldn't allocate memory for test");
+
+  start_largest = largest_block (&buddy);
+  for (i = 0; i < 2; i++) 
+    {
+      const struct allocator *a = allocators[i];
+      struct result r;
+
+      run (a, &r);
+      msg ("%s: %"PRIu64" cycles/op, %d failed allocations, "
+           "largest free block %zu pages.",
+           a->name, r.cycles / OP_CNT, r.failures, r.largest);
+    }
+  bitmap_destroy (old_map);
+
+  if (largest_block (&buddy) != start_largest)
+    fail ("user pool did not coalesce: largest block %zu pages, "
+          "expected %zu", largest_block (&buddy), start_largest);
+  pass ();
+}
+
+/* Runs the workload against allocator A, storing the results in
+   *R, and frees everything it allocated. */
+static void
+run (const struct allocator *a, struct result *r) 
+{
+  size_t idx[SLOT_CNT], cnt[SLOT_CNT];
+  int i;
+
+  r->cycles = 0;
+  r->failures = 0;
+  for (i = 0; i < SLOT_CNT; i++)
+    cnt[i] = 0;
+
+  random_init (SEED);
+  for (i = 0; i < OP_CNT; i++) 
+    {
+      int slot = random_ulong () % SLOT_CNT;
+      uint64_t start = read_tsc ();
+
+      if (cnt[slot] != 0) 
+        {
+          a->free (idx[slot], cnt[slot]);
+          cnt[slot] = 0;
+        }
+      else 
+        {
+          size_t page_cnt = (random_ulong () % 2
+                             ? 1 : 1 + random_ulong () % MAX_PAGES);
+          idx[slot] = a->alloc (page_cnt);
+          if (idx[slot] != BITMAP_ERROR)
+            cnt[slot] = page_cnt;
+          else
+            r->failures++;
+        }
+      r->cycles += read_tsc () - start;
+    }
+
+  r->largest = largest_block (a);
+  for (i = 0; i < SLOT_CNT; i++)
+    if (cnt[i] != 0)
+      a->free (idx[i], cnt[i]);
+}
+
+/* Returns the largest number of contiguous pages that A can
+   allocate, by binary search. */
+static size_t
+largest_block (const struct allocator *a) 
+{
+  size_t lo = 0, hi = pool_pages;
+
+  while (lo < hi) 
+    {
+      size_t mid = (lo + hi + 1) / 2;
+      size_t page_idx = a->alloc (mid);
+      if (page_idx != BITMAP_ERROR) 
+        {
+          a->free (page_idx, mid);
+          lo = mid;
+        }
+      else
+        hi = mid - 1;
+    }
+  return lo;
+}
+
+static size_t
+palloc_alloc (size_t page_cnt) 
+{
+  uint8_t *pages = palloc_get_multiple (PAL_USER, page_cnt);
+  return pages != NULL ? (size_t) (pages - pool_base) / PGSIZE : BITMAP_ERROR;
+}
+
+static void
+palloc_free (size_t page_idx, size_t page_cnt) 
+{
+  palloc_free_multiple (pool_base + page_idx * PGSIZE, page_cnt);
+}
+
+static size_t
+bitmap_alloc (size_t page_cnt) 
+{
+  return bitmap_scan_and_flip (old_map, 0, page_cnt, false);
+}
+
+static void
+bitmap_free (size_t page_idx, size_t page_cnt) 
+{
+  bitmap_set_multiple (old_map, page_idx, page_cnt, false);
+}
@@ -0,0 +1,198 @@
+/* Runs several readers and writers against one readers-writer
+   lock, with readers holding the lock back to back so that a
+   readers-first lock would starve the writers.  Checks that
+   readers and writers never hold the lock at the same time and
+   that every thread finishes, then reports percentiles of the
+   time readers and writers waited to acquire the lock.  Also
+   checks upgrading and downgrading an uncontended lock. */
+
+#include <inttypes.h>
+#include <random.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "tests/threads/tests.h"
+#include "threads/interrupt.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/tsc.h"
+#include "devices/timer.h"
+
+#define READER_CNT 6            /* Number of reader threads. */
+#define WRITER_CNT 2            /* Number of writer threads. */
+#define OP_CNT 40               /* Lock acquisitions per thread. */
+
+/* State shared by the whole test. */
+struct rwlock_test
+  {
+    struct rwlock rw;           /* The lock under test. */
+    struct semaphore done;      /* Upped by each finished thread. */
+
+    /* Threads holding RW, changed with interrupts off. */
+    int readers;                /* Current readers. */
+    int writers;                /* Current writers. */
+    int violations;             /* Times exclusion was broken. */
+
+    /* Acquisition latencies, in CPU cycles. */
+    uint64_t read_waits[READER_CNT * OP_CNT];
+    uint64_t write_waits[WRITER_CNT * OP_CNT];
+  };
+
+/* Per-thread argument. */
+struct rwlock_thread
+  {
+    struct rwlock_test *test;
+    int id;
+  };
+
+static thread_func reader_thread, writer_thread;
+static void enter (struct rwlock_test *, bool writer);
+static void leave (struct rwlock_test *, bool writer);
+static void report (const char *, uint64_t *waits, size_t cnt);
+
+void
+test_rwlock_fair (void) 
+{
+  struct rwlock_test *test;
+  struct rwlock_thread args[READER_CNT + WRITER_CNT];
+  int i;
+
+  test = malloc (sizeof *test);
+  if (test == NULL)
+    PANIC ("couldn't allocate memory for test");
+  rwlock_init (&test->rw);
+  sema_init (&test->done, 0);
+  test->readers = test->writers = test->violations = 0;
+
+  /* Upgrade and downgrade without contention. */
+  rwlock_reader_lock (&test->rw);
+  if (!rwlock_upgrade (&test->rw))
+    fail ("upgrading the only read lock failed");
+  rwlock_downgrade (&test->rw);
+  rwlock_reader_unlock (&test->rw);
+
+  msg ("Starting %d readers and %d writers, %d acquisitions each.",
+       READER_CNT, WRITER_CNT, OP_CNT);
+  for (i = 0; i < READER_CNT + WRITER_CNT; i++) 
+    {
+      char name[16];
+      bool writer = i >= READER_CNT;
+
+      args[i].test = test;
+      args[i].id = writer ? i - READER_CNT : i;
+      snprintf (name, sizeof name, "%s %d", writer ? "writer" : "reader",
+                args[i].id);
+      thread_create (name, PRI_DEFAULT,
+                     writer ? writer_thread : reader_thread, &args[i]);
+    }
+  for (i = 0; i < READER_CNT + WRITER_CNT; i++)
+    sema_down (&test->done);
+
+  if (test->violations > 0)
+    fail ("mutual exclusion violated %d times", test->violations);
+  msg ("All threads finished.");
+  report ("Reader", test->read_waits, READER_CNT * OP_CNT);
+  report ("Writer", test->write_waits, WRITER_CNT * OP_CNT);
+  free (test);
+  pass ();
+}
+
+/* Reader thread: takes the read lock over and over, sometimes
+   sleeping while holding it, with no pause in between. */
+static void
+reader_thread (void *arg_) 
+{
+  struct rwlock_thread *arg = arg_;
+  struct rwlock_test *test = arg->test;
+  int i;
+
+  for (i = 0; i < OP_CNT; i++) 
+    {
+      uint64_t start = read_tsc ();
+      rwlock_reader_lock (&test->rw);
+      test->read_waits[arg->id * OP_CNT + i] = read_tsc () - start;
+
+      enter (test, false);
+      if (random_ulong () % 2)
+        timer_sleep (1);
+      else
+        thread_yield ();
+      leave (test, false);
+
+      rwlock_reader_unlock (&test->rw);
+    }
+  sema_up (&test->done);
+}
+
+/* Writer thread: takes the write lock, yields while holding it,
+   and sleeps a little before trying again. */
+static void
+writer_thread (void *arg_) 
+{
+  struct rwlock_thread *arg = arg_;
+  struct rwlock_test *test = arg->test;
+  int i;
+
+  for (i = 0; i < OP_CNT; i++) 
+    {
+      uint64_t start = read_tsc ();
+      rwlock_writer_lock (&test->rw);
+      test->write_waits[arg->id * OP_CNT + i] = read_tsc () - start;
+
+      enter (test, true);
+      thread_yield ();
+      leave (test, true);
+
+      rwlock_writer_unlock (&test->rw);
+      timer_sleep (1 + random_ulong () % 2);
+    }
+  sema_up (&test->done);
+}
+
+/* Records that the current thread now holds TEST's lock, as a
+   writer if WRITER is true, and checks for conflicts. */
+static void
+enter (struct rwlock_test *test, bool writer) 
+{
+  enum intr_level old_level = intr_disable ();
+  if (writer ? test->readers > 0 || test->writers > 0 : test->writers > 0)
+    test->violations++;
+  if (writer)
+    test->writers++;
+  else
+    test->readers++;
+  intr_set_level (old_level);
+}
+
+/* Records that the current thread is about to release TEST's
+   lock. */
+static void
+leave (struct rwlock_test *test, bool writer) 
+{
+  enum intr_level old_level = intr_disable ();
+  if (writer)
+    test->writers--;
+  else
+    test->readers--;
+  intr_set_level (old_level);
+}
+
+/* qsort() comparison function for uint64_t. */
+static int
+compare_uint64 (const void *a_, const void *b_) 
+{
+  const uint64_t *a = a_;
+  const uint64_t *b = b_;
+
+  return *a < *b ? -1 : *a > *b;
+}
+
+/* Prints percentiles of the CNT latencies in WAITS. */
+static void
+report (const char *who, uint64_t *waits, size_t cnt) 
+{
+  qsort (waits, cnt, sizeof *waits, compare_uint64);
+  msg ("%s wait cycles: p50 %"PRIu64", p90 %"PRIu64", p99 %"PRIu64
+       ", max %"PRIu64".", who, waits[cnt / 2], waits[cnt * 9 / 10],
+       waits[cnt * 99 / 100], waits[cnt - 1]);
+}
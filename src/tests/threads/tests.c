@@ -17,6 +17,7 @@ static const struct test tests[] =
     {"alarm-priority", test_alarm_priority},
     {"alarm-zero", test_alarm_zero},
     {"alarm-negative", test_alarm_negative},
+    {"alarm-stress", test_alarm_stress},
     {"priority-change", test_priority_change},
     {"priority-donate-one", test_priority_donate_one},
     {"priority-donate-multiple", test_priority_donate_multiple},
@@ -38,6 +39,13 @@ static const struct test tests[] =
     {"mlfqs-nice-2", test_mlfqs_nice_2},
     {"mlfqs-nice-10", test_mlfqs_nice_10},
     {"mlfqs-block", test_mlfqs_block},
+    {"workqueue", test_workqueue},
+    {"rwlock-fair", test_rwlock_fair},
+    {"condvar-timeout", test_condvar_timeout},
+    {"palloc-buddy", test_palloc_buddy},
+    {"bitmap-scan", test_bitmap_scan},
+    {"lz-compress", test_lz_compress},
+    {"context-switch", test_context_switch},
     {"threadtest", ThreadTest},
     {"simplethreadtest", SimpleThreadTest}
   };
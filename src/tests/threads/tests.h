@@ -11,6 +11,7 @@ extern test_func test_alarm_simultaneous;
 extern test_func test_alarm_priority;
 extern test_func test_alarm_zero;
 extern test_func test_alarm_negative;
+extern test_func test_alarm_stress;
 extern test_func test_priority_change;
 extern test_func test_priority_donate_one;
 extern test_func test_priority_donate_multiple;
@@ -32,6 +33,13 @@ extern test_func test_mlfqs_fair_20;
 extern test_func test_mlfqs_nice_2;
 extern test_func test_mlfqs_nice_10;
 extern test_func test_mlfqs_block;
+extern test_func test_workqueue;
+extern test_func test_rwlock_fair;
+extern test_func test_condvar_timeout;
+extern test_func test_palloc_buddy;
+extern test_func test_bitmap_scan;
+extern test_func test_lz_compress;
+extern test_func test_context_switch;
 extern test_func ThreadTest;
 extern test_func SimpleThreadTest;
 
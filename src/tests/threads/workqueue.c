@@ -0,0 +1,92 @@
+/* Queues work items from an alarm, that is, from the timer
+   interrupt handler, and checks that the workqueue's thread runs
+   them in order, in thread context, and only once even when a
+   pending item is queued again. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/interrupt.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/workqueue.h"
+#include "devices/timer.h"
+
+#define WORK_CNT 5
+
+/* One work item in the test. */
+struct test_work
+  {
+    struct work work;           /* The work item. */
+    int id;                     /* Index in works[]. */
+  };
+
+static struct workqueue *wq;
+static struct test_work works[WORK_CNT];
+static bool requeued;                   /* Result of queuing twice. */
+static int order[WORK_CNT];             /* IDs in the order run. */
+static bool in_intr[WORK_CNT];          /* Ran in interrupt context? */
+static int run_cnt;                     /* Number of items run. */
+static struct semaphore done;           /* Upped by the last item. */
+
+static alarm_func queue_works;
+static work_func run_work;
+
+void
+test_workqueue (void) 
+{
+  struct alarm alarm;
+  int i;
+
+  wq = workqueue_create ("test-wq", PRI_DEFAULT + 1);
+  if (wq == NULL)
+    PANIC ("couldn't create workqueue");
+
+  sema_init (&done, 0);
+  run_cnt = 0;
+  for (i = 0; i < WORK_CNT; i++) 
+    {
+      works[i].id = i;
+      work_init (&works[i].work, run_work, &works[i]);
+    }
+
+  alarm_init (&alarm, queue_works, NULL);
+  alarm_set (&alarm, timer_ticks () + 1);
+  sema_down (&done);
+
+  if (requeued)
+    fail ("queuing a pending work item succeeded");
+  if (run_cnt != WORK_CNT)
+    fail ("%d work items ran, expected %d", run_cnt, WORK_CNT);
+  for (i = 0; i < WORK_CNT; i++) 
+    {
+      if (in_intr[i])
+        fail ("work item %d ran in interrupt context", order[i]);
+      msg ("work item %d ran", order[i]);
+    }
+  pass ();
+}
+
+/* Alarm function: queues every work item from the timer
+   interrupt, the first one twice. */
+static void
+queue_works (void *aux UNUSED) 
+{
+  int i;
+
+  for (i = 0; i < WORK_CNT; i++)
+    work_queue (wq, &works[i].work);
+  requeued = work_queue (wq, &works[0].work);
+}
+
+/* Work function: records that TW_ ran. */
+static void
+run_work (void *tw_) 
+{
+  struct test_work *tw = tw_;
+
+  in_intr[run_cnt] = intr_context ();
+  order[run_cnt] = tw->id;
+  if (++run_cnt == WORK_CNT)
+    sema_up (&done);
+}
@@ -0,0 +1,15 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(workqueue) begin
+(workqueue) work item 0 ran
+(workqueue) work item 1 ran
+(workqueue) work item 2 ran
+(workqueue) work item 3 ran
+(workqueue) work item 4 ran
+(workqueue) PASS
+(workqueue) end
+EOF
+pass;
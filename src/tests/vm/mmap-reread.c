@@ -0,0 +1,64 @@
+/* Reads part of a mapped file sequentially, so that the pages
+   after it are read ahead, then unmaps it, rewrites the file
+   with the write system call, maps it again, and verifies that
+   the mapping shows the new data, not what was read ahead. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define ACTUAL ((char *) 0x10000000)
+#define PAGE_CNT 32
+#define PAGE_SIZE 4096
+
+static char buf[PAGE_SIZE];
+
+/* Writes PAGE_CNT pages of byte VALUE to HANDLE, from the start. */
+static void
+fill (int handle, char value)
+{
+  size_t i;
+
+  memset (buf, value, sizeof buf);
+  seek (handle, 0);
+  for (i = 0; i < PAGE_CNT; i++)
+    if (write (handle, buf, sizeof buf) != (int) sizeof buf)
+      fail ("write failed");
+}
+
+void
+test_main (void)
+{
+  int handle;
+  mapid_t map;
+  size_t i;
+
+  CHECK (create ("data", PAGE_CNT * PAGE_SIZE), "create \"data\"");
+  CHECK ((handle = open ("data")) > 1, "open \"data\"");
+  fill (handle, 0x11);
+
+  /* Read the first pages in order, then let the read-ahead
+     settle before unmapping. */
+  CHECK ((map = mmap (handle, ACTUAL)) != MAP_FAILED, "mmap \"data\"");
+  for (i = 0; i < PAGE_CNT / 4; i++)
+    if (ACTUAL[i * PAGE_SIZE] != 0x11)
+      fail ("byte %zu of first mapping has value %02hhx (should be 11)",
+            i * PAGE_SIZE, ACTUAL[i * PAGE_SIZE]);
+  msg ("scan first mapping");
+  for (i = 0; i < 100000; i++)
+    asm volatile ("");
+  munmap (map);
+
+  fill (handle, 0x22);
+  msg ("rewrite \"data\"");
+
+  CHECK ((map = mmap (handle, ACTUAL)) != MAP_FAILED, "mmap \"data\" again");
+  for (i = 0; i < PAGE_CNT * PAGE_SIZE; i++)
+    if (ACTUAL[i] != 0x22)
+      fail ("byte %zu of second mapping has value %02hhx (should be 22)",
+            i, ACTUAL[i]);
+  msg ("verify second mapping");
+  munmap (map);
+  close (handle);
+}
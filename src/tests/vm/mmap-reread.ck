@@ -0,0 +1,16 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(mmap-reread) begin
+(mmap-reread) create "data"
+(mmap-reread) open "data"
+(mmap-reread) mmap "data"
+(mmap-reread) scan first mapping
+(mmap-reread) rewrite "data"
+(mmap-reread) mmap "data" again
+(mmap-reread) verify second mapping
+(mmap-reread) end
+EOF
+pass;
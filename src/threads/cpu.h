@@ -0,0 +1,67 @@
+#ifndef THREADS_CPU_H
+#define THREADS_CPU_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Feature flags returned in EDX by CPUID leaf 1.
+   See [IA32-v2a] "CPUID". */
+#define CPUID_PSE 0x00000008    /* 4 MB pages. */
+#define CPUID_PGE 0x00002000    /* Global pages. */
+
+/* CR4 flags.  See [IA32-v3a] 2.5 "Control Registers". */
+#define CR4_PSE 0x00000010      /* Page Size Extensions enable. */
+#define CR4_PGE 0x00000080      /* Page Global Enable. */
+
+/* Returns true if the CPU has all the CPUID leaf 1 EDX features
+   in FLAGS. */
+static inline bool
+cpu_has (uint32_t flags)
+{
+  /* See [IA32-v2a] "CPUID". */
+  uint32_t eax, ebx, ecx, edx;
+  asm ("cpuid" : "=a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx) : "a" (1));
+  return (edx & flags) == flags;
+}
+
+/* Returns the contents of CR4. */
+static inline uint32_t
+cr4_read (void)
+{
+  /* See [IA32-v2a] "MOV--Move to/from Control Registers". */
+  uint32_t cr4;
+  asm volatile ("movl %%cr4, %0" : "=r" (cr4));
+  return cr4;
+}
+
+/* Stores CR4 into the CR4 register. */
+static inline void
+cr4_write (uint32_t cr4)
+{
+  /* See [IA32-v2a] "MOV--Move to/from Control Registers". */
+  asm volatile ("movl %0, %%cr4" : : "r" (cr4) : "memory");
+}
+
+/* Returns the contents of CR3, the physical address of the
+   active page directory. */
+static inline uint32_t
+cr3_read (void)
+{
+  /* See [IA32-v2a] "MOV--Move to/from Control Registers". */
+  uint32_t cr3;
+  asm volatile ("movl %%cr3, %0" : "=r" (cr3));
+  return cr3;
+}
+
+/* Stores CR3 into the CR3 register, which activates the page
+   directory at that physical address and flushes all TLB entries
+   that are not global.  See [IA32-v3a] 3.12 "Translation
+   Lookaside Buffers (TLBs)". */
+static inline void
+cr3_write (uint32_t cr3)
+{
+  /* See [IA32-v2a] "MOV--Move to/from Control Registers". */
+  asm volatile ("movl %0, %%cr3" : : "r" (cr3) : "memory");
+}
+
+#endif /* threads/cpu.h */
@@ -13,13 +13,17 @@
 #include "devices/serial.h"
 #include "devices/timer.h"
 #include "devices/vga.h"
+#include "threads/cpu.h"
 #include "threads/interrupt.h"
 #include "threads/io.h"
 #include "threads/loader.h"
 #include "threads/malloc.h"
 #include "threads/palloc.h"
 #include "threads/pte.h"
+#include "threads/slab.h"
+#include "threads/synch.h"
 #include "threads/thread.h"
+#include "threads/workqueue.h"
 #ifdef USERPROG
 #include "userprog/process.h"
 #include "userprog/exception.h"
@@ -34,6 +38,11 @@
 #include "filesys/filesys.h"
 #include "filesys/fsutil.h"
 #endif
+#ifdef VM
+#include "vm/frame.h"
+#include "vm/page.h"
+#include "vm/swap.h"
+#endif
 
 /* Amount of physical memory, in 4 kB pages. */
 size_t ram_pages;
@@ -86,6 +95,7 @@ main (void)
   /* Initialize memory system. */
   palloc_init ();
   malloc_init ();
+  kmem_init ();
   paging_init ();
 
   /* Segmentation. */
@@ -93,6 +103,12 @@ main (void)
   tss_init ();
   gdt_init ();
 
+  process_init ();
+#ifdef VM
+  page_init ();
+  frame_init ();
+#endif
+
   /* Initialize hash here since this is not a user process */
   hash_init (&(thread_current())->children_hash, child_status_hash_func,
              child_status_less_func, NULL);
@@ -111,6 +127,7 @@ main (void)
 
   /* Start thread scheduler and enable interrupts. */
   thread_start ();
+  workqueue_init ();
   serial_init_queue ();
   timer_calibrate ();
 
@@ -120,6 +137,12 @@ main (void)
   filesys_init (format_filesys);
 #endif
 
+#ifdef VM
+  /* Initialize swap space and start prefetching. */
+  swap_init ();
+  frame_init_prefetch ();
+#endif
+
   printf ("Boot complete.\n");
   
   /* Run actions specified on kernel command line. */
@@ -156,12 +179,25 @@ ram_init (void)
    At the time this function is called, the active page table
    (set up by loader.S) only maps the first 4 MB of RAM, so we
    should not try to use extravagant amounts of memory.
-   Fortunately, there is no need to do so. */
+   Fortunately, there is no need to do so.
+
+   If the CPU supports it, each 4 MB region of RAM is mapped
+   with a single 4 MB page, which needs no page table and only
+   one TLB entry.  Regions that contain read-only kernel text, or
+   that RAM covers only in part, still get a page table, so that
+   they can be mapped page by page.
+
+   Also if the CPU supports it, the kernel mappings are marked
+   global, so that their TLB entries survive the CR3 reloads that
+   switch between processes' page directories. */
 static void
 paging_init (void)
 {
   uint32_t *pd, *pt;
   size_t page;
+  bool pse = cpu_has (CPUID_PSE);
+  bool pge = cpu_has (CPUID_PGE);
+  uint32_t global = pge ? PTE_G : 0;
   extern char _start, _end_kernel_text;
 
   pd = base_page_dir = palloc_get_page (PAL_ASSERT | PAL_ZERO);
@@ -176,19 +212,39 @@ paging_init (void)
 
       if (pd[pde_idx] == 0)
         {
+          char *region_end = vaddr + PTSPAN;
+
+          if (pse && pte_idx == 0
+              && page + PTSPAN / PGSIZE <= ram_pages
+              && (region_end <= &_start || vaddr >= &_end_kernel_text))
+            {
+              pd[pde_idx] = pde_create_large (vaddr, true) | global;
+              page += PTSPAN / PGSIZE - 1;
+              continue;
+            }
+
           pt = palloc_get_page (PAL_ASSERT | PAL_ZERO);
           pd[pde_idx] = pde_create (pt);
         }
 
-      pt[pte_idx] = pte_create_kernel (vaddr, !in_kernel_text);
+      pt[pte_idx] = pte_create_kernel (vaddr, !in_kernel_text) | global;
     }
 
+  /* Enable 4 MB pages before they come into use. */
+  if (pse)
+    cr4_write (cr4_read () | CR4_PSE);
+
   /* Store the physical address of the page directory into CR3
      aka PDBR (page directory base register).  This activates our
-     new page tables immediately.  See [IA32-v2a] "MOV--Move
-     to/from Control Registers" and [IA32-v3a] 3.7.5 "Base Address
-     of the Page Directory". */
-  asm volatile ("movl %0, %%cr3" : : "r" (vtop (base_page_dir)));
+     new page tables immediately.  See [IA32-v3a] 3.7.5 "Base
+     Address of the Page Directory". */
+  cr3_write (vtop (base_page_dir));
+
+  /* Honor the global bits only now that the mappings of the
+     loader's page table, which are not global, are gone.  See
+     [IA32-v3a] 3.12 "Translation Lookaside Buffers (TLBs)". */
+  if (pge)
+    cr4_write (cr4_read () | CR4_PGE);
 }
 
 /* Breaks the kernel command line into words and returns them as
@@ -252,6 +308,12 @@ parse_options (char **argv)
 #ifdef USERPROG
       else if (!strcmp (name, "-ul"))
         user_page_limit = atoi (value);
+#endif
+#ifdef VM
+      else if (!strcmp (name, "-sl"))
+        stack_page_limit = atoi (value);
+      else if (!strcmp (name, "-pf"))
+        page_fault_report = true;
 #endif
       else
         PANIC ("unknown option `%s' (use -h for help)", name);
@@ -356,6 +418,10 @@ usage (void)
           "  -mlfqs             Use multi-level feedback queue scheduler.\n"
 #ifdef USERPROG
           "  -ul=COUNT          Limit user memory to COUNT pages.\n"
+#endif
+#ifdef VM
+          "  -sl=COUNT          Limit user stacks to COUNT pages.\n"
+          "  -pf                Print page fault counts of each process.\n"
 #endif
           );
   power_off ();
@@ -392,12 +458,24 @@ print_stats (void)
 {
   timer_print_stats ();
   thread_print_stats ();
+  workqueue_print_stats ();
+  palloc_print_stats ();
+  malloc_print_stats ();
+  kmem_print_stats ();
 #ifdef FILESYS
   disk_print_stats ();
+#endif
+#ifdef LOCK_PROFILE
+  lock_print_stats ();
 #endif
   console_print_stats ();
   kbd_print_stats ();
 #ifdef USERPROG
   exception_print_stats ();
 #endif
+#ifdef VM
+  frame_print_stats ();
+  page_print_stats ();
+  swap_print_stats ();
+#endif
 }
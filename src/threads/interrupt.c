@@ -353,6 +353,9 @@ intr_handler (struct intr_frame *frame)
 
       in_external_intr = true;
       yield_on_return = false;
+
+      /* Catch up on ticks skipped by a tickless idle period. */
+      timer_tickless_exit ();
     }
 
   /* Invoke the interrupt's handler. */
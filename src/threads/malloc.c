@@ -11,11 +11,15 @@
 
 /* A simple implementation of malloc().
 
-   The size of each request, in bytes, is rounded up to a power
-   of 2 and assigned to the "descriptor" that manages blocks of
-   that size.  The descriptor keeps a list of free blocks.  If
-   the free list is nonempty, one of its blocks is used to
-   satisfy the request.
+   The size of each request, in bytes, is rounded up to the next
+   size class and assigned to the "descriptor" that manages
+   blocks of that size.  The size classes are the powers of 2 and
+   the midpoints between them (16, 24, 32, 48, ...), so that at
+   most a third of a block is wasted, up to 1 kB.  Above that,
+   there are two classes that split an arena's space evenly
+   between three and two blocks.  The descriptor keeps a list of
+   free blocks.  If the free list is nonempty, one of its blocks
+   is used to satisfy the request.
 
    Otherwise, a new page of memory, called an "arena", is
    obtained from the page allocator (if none is available,
@@ -41,6 +45,12 @@ struct desc
     size_t blocks_per_arena;    /* Number of blocks in an arena. */
     struct list free_list;      /* List of free blocks. */
     struct lock lock;           /* Lock. */
+
+    /* Statistics. */
+    long long alloc_cnt;        /* Number of blocks allocated. */
+    long long free_cnt;         /* Number of blocks freed. */
+    size_t arena_cnt;           /* Current number of arenas. */
+    size_t max_arena_cnt;       /* Largest ARENA_CNT so far. */
   };
 
 /* Magic number for detecting arena corruption. */
@@ -61,27 +71,74 @@ struct block
   };
 
 /* Our set of descriptors. */
-static struct desc descs[10];   /* Descriptors. */
+static struct desc descs[20];   /* Descriptors. */
 static size_t desc_cnt;         /* Number of descriptors. */
 
+/* Statistics for big blocks.  Protected by big_lock. */
+static struct lock big_lock;
+static long long big_alloc_cnt; /* Number of big blocks allocated. */
+static long long big_free_cnt;  /* Number of big blocks freed. */
+static size_t big_page_cnt;     /* Pages currently in big blocks. */
+
 static struct arena *block_to_arena (struct block *);
 static struct block *arena_to_block (struct arena *, size_t idx);
+static void add_desc (size_t block_size);
 
 /* Initializes the malloc() descriptors. */
 void
 malloc_init (void) 
 {
+  size_t arena_space = PGSIZE - sizeof (struct arena);
   size_t block_size;
 
-  for (block_size = 16; block_size < PGSIZE / 2; block_size *= 2)
+  for (block_size = 16; block_size <= 1024; block_size *= 2)
     {
-      struct desc *d = &descs[desc_cnt++];
-      ASSERT (desc_cnt <= sizeof descs / sizeof *descs);
-      d->block_size = block_size;
-      d->blocks_per_arena = (PGSIZE - sizeof (struct arena)) / block_size;
-      list_init (&d->free_list);
-      lock_init (&d->lock);
+      add_desc (block_size);
+      if (block_size < 1024)
+        add_desc (block_size + block_size / 2);
     }
+  add_desc (ROUND_DOWN (arena_space / 3, sizeof (void *)));
+  add_desc (ROUND_DOWN (arena_space / 2, sizeof (void *)));
+
+  lock_init (&big_lock);
+}
+
+/* Adds a descriptor for blocks of BLOCK_SIZE bytes.  Descriptors
+   must be added in increasing order of size. */
+static void
+add_desc (size_t block_size) 
+{
+  struct desc *d = &descs[desc_cnt++];
+
+  ASSERT (desc_cnt <= sizeof descs / sizeof *descs);
+  ASSERT (desc_cnt == 1 || d[-1].block_size < block_size);
+
+  d->block_size = block_size;
+  d->blocks_per_arena = (PGSIZE - sizeof (struct arena)) / block_size;
+  list_init (&d->free_list);
+  lock_init (&d->lock);
+  d->alloc_cnt = d->free_cnt = 0;
+  d->arena_cnt = d->max_arena_cnt = 0;
+}
+
+/* Prints statistics for each descriptor that has been used, and
+   for big blocks. */
+void
+malloc_print_stats (void) 
+{
+  struct desc *d;
+
+  for (d = descs; d < descs + desc_cnt; d++)
+    if (d->alloc_cnt > 0)
+      printf ("Malloc %zu-byte blocks: %lld allocs, %lld frees, "
+              "%lld live, %zu arenas (%zu peak)\n",
+              d->block_size, d->alloc_cnt, d->free_cnt,
+              d->alloc_cnt - d->free_cnt, d->arena_cnt, d->max_arena_cnt);
+  if (big_alloc_cnt > 0)
+    printf ("Malloc big blocks: %lld allocs, %lld frees, "
+            "%lld live, %zu pages\n",
+            big_alloc_cnt, big_free_cnt,
+            big_alloc_cnt - big_free_cnt, big_page_cnt);
 }
 
 /* Obtains and returns a new block of at least SIZE bytes.
@@ -116,6 +173,12 @@ malloc (size_t size)
       a->magic = ARENA_MAGIC;
       a->desc = NULL;
       a->free_cnt = page_cnt;
+
+      lock_acquire (&big_lock);
+      big_alloc_cnt++;
+      big_page_cnt += page_cnt;
+      lock_release (&big_lock);
+
       return a + 1;
     }
 
@@ -143,12 +206,15 @@ malloc (size_t size)
           struct block *b = arena_to_block (a, i);
           list_push_back (&d->free_list, &b->free_elem);
         }
+      if (++d->arena_cnt > d->max_arena_cnt)
+        d->max_arena_cnt = d->arena_cnt;
     }
 
   /* Get a block from free list and return it. */
   b = list_entry (list_pop_front (&d->free_list), struct block, free_elem);
   a = block_to_arena (b);
   a->free_cnt--;
+  d->alloc_cnt++;
   lock_release (&d->lock);
   return b;
 }
@@ -186,7 +252,8 @@ block_size (void *block)
 }
 
 /* Attempts to resize OLD_BLOCK to NEW_SIZE bytes, possibly
-   moving it in the process.
+   moving it in the process.  OLD_BLOCK is returned unmoved if it
+   is already big enough.
    If successful, returns the new block; on failure, returns a
    null pointer.
    A call with null OLD_BLOCK is equivalent to malloc(NEW_SIZE).
@@ -199,6 +266,8 @@ realloc (void *old_block, size_t new_size)
       free (old_block);
       return NULL;
     }
+  else if (old_block != NULL && new_size <= block_size (old_block))
+    return old_block;
   else 
     {
       void *new_block = malloc (new_size);
@@ -237,6 +306,7 @@ free (void *p)
 
           /* Add block to free list. */
           list_push_front (&d->free_list, &b->free_elem);
+          d->free_cnt++;
 
           /* If the arena is now entirely unused, free it. */
           if (++a->free_cnt >= d->blocks_per_arena) 
@@ -250,6 +320,7 @@ free (void *p)
                   list_remove (&b->free_elem);
                 }
               palloc_free_page (a);
+              d->arena_cnt--;
             }
 
           lock_release (&d->lock);
@@ -257,6 +328,11 @@ free (void *p)
       else
         {
           /* It's a big block.  Free its pages. */
+          lock_acquire (&big_lock);
+          big_free_cnt++;
+          big_page_cnt -= a->free_cnt;
+          lock_release (&big_lock);
+
           palloc_free_multiple (a, a->free_cnt);
           return;
         }
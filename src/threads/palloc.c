@@ -2,14 +2,15 @@
 #include <bitmap.h>
 #include <debug.h>
 #include <inttypes.h>
+#include <list.h>
 #include <round.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
 #include "threads/init.h"
+#include "threads/interrupt.h"
 #include "threads/loader.h"
-#include "threads/synch.h"
 #include "threads/vaddr.h"
 
 /* Page allocator.  Hands out memory in page-size (or
@@ -24,13 +25,52 @@
 
    By default, half of system RAM is given to the kernel pool and
    half to the user pool.  That should be huge overkill for the
-   kernel pool, but that's just fine for demonstration purposes. */
+   kernel pool, but that's just fine for demonstration purposes.
+
+   Each pool is managed by a binary buddy allocator.  Free pages
+   are kept in blocks of 2**ORDER pages, aligned to their size
+   relative to the pool base, on one free list per order.  An
+   allocation takes a block from the smallest order that is big
+   enough, splitting larger blocks as needed, and returns any
+   pages beyond the ones requested.  Freeing a block merges it
+   with its "buddy", the other half of the block it was split
+   from, for as long as the buddy is free too.  Both take time
+   logarithmic in the pool size.
+
+   The pools are protected by disabling interrupts rather than by
+   a lock, because their critical sections are short and pages are
+   freed by schedule_tail(), which runs with interrupts off.
+
+   Each pool also keeps a small stock of pages that the idle
+   thread has already filled with zeros, so that single-page
+   PAL_ZERO requests, such as for thread stacks, page tables, and
+   user stack and bss pages, need not clear the page while the
+   caller waits.  These pages count as allocated as far as the
+   buddy allocator is concerned; if it runs out of memory, they
+   are given back to it. */
+
+/* Number of block orders.  The largest block has
+   2**(BUDDY_ORDERS - 1) pages. */
+#define BUDDY_ORDERS 16
+
+/* Maximum number of pre-zeroed pages kept in each pool. */
+#define ZEROED_MAX 64
+
+/* Per-page bookkeeping for the buddy allocator. */
+struct buddy_page
+  {
+    struct list_elem elem;      /* Free or zeroed list element. */
+    int order;                  /* Order if free block head, else -1. */
+  };
 
 /* A memory pool. */
 struct pool
   {
-    struct lock lock;                   /* Mutual exclusion. */
     struct bitmap *used_map;            /* Bitmap of free pages. */
+    struct buddy_page *pages;           /* One entry per page. */
+    struct list free_lists[BUDDY_ORDERS]; /* Free blocks by order. */
+    struct list zeroed;                 /* Pre-zeroed pages. */
+    size_t zeroed_cnt;                  /* Number of pages in ZEROED. */
     uint8_t *base;                      /* Base of pool. */
   };
 
@@ -40,9 +80,18 @@ struct pool kernel_pool, user_pool;
 /* Maximum number of pages to put in user pool. */
 size_t user_page_limit = SIZE_MAX;
 
+/* PAL_ZERO page requests satisfied from, and not from, the
+   pre-zeroed pages. */
+static long long zeroed_hits, zeroed_misses;
+
 static void init_pool (struct pool *, void *base, size_t page_cnt,
                        const char *name);
 static bool page_from_pool (const struct pool *, void *page);
+static size_t buddy_alloc (struct pool *, size_t page_cnt);
+static void buddy_free (struct pool *, size_t page_idx, size_t page_cnt);
+static void *get_zeroed_page (struct pool *);
+static void release_zeroed (struct pool *);
+static bool zero_page (struct pool *);
 
 /* Initializes the page allocator. */
 void
@@ -80,13 +129,31 @@ palloc_get_multiple (enum palloc_flags flags, size_t page_cnt)
   struct pool *pool = flags & PAL_USER ? &user_pool : &kernel_pool;
   void *pages;
   size_t page_idx;
+  enum intr_level old_level;
 
   if (page_cnt == 0)
     return NULL;
 
-  lock_acquire (&pool->lock);
-  page_idx = bitmap_scan_and_flip (pool->used_map, 0, page_cnt, false);
-  lock_release (&pool->lock);
+  if (page_cnt == 1 && (flags & PAL_ZERO)) 
+    {
+      pages = get_zeroed_page (pool);
+      if (pages != NULL)
+        return pages;
+    }
+
+  old_level = intr_disable ();
+  page_idx = buddy_alloc (pool, page_cnt);
+  if (page_idx == BITMAP_ERROR && pool->zeroed_cnt > 0) 
+    {
+      release_zeroed (pool);
+      page_idx = buddy_alloc (pool, page_cnt);
+    }
+  if (page_idx != BITMAP_ERROR)
+    {
+      ASSERT (bitmap_none (pool->used_map, page_idx, page_cnt));
+      bitmap_set_multiple (pool->used_map, page_idx, page_cnt, true);
+    }
+  intr_set_level (old_level);
 
   if (page_idx != BITMAP_ERROR)
     pages = pool->base + PGSIZE * page_idx;
@@ -126,6 +193,7 @@ palloc_free_multiple (void *pages, size_t page_cnt)
 {
   struct pool *pool;
   size_t page_idx;
+  enum intr_level old_level;
 
   ASSERT (pg_ofs (pages) == 0);
   if (pages == NULL || page_cnt == 0)
@@ -144,8 +212,11 @@ palloc_free_multiple (void *pages, size_t page_cnt)
   memset (pages, 0xcc, PGSIZE * page_cnt);
 #endif
 
+  old_level = intr_disable ();
   ASSERT (bitmap_all (pool->used_map, page_idx, page_cnt));
   bitmap_set_multiple (pool->used_map, page_idx, page_cnt, false);
+  buddy_free (pool, page_idx, page_cnt);
+  intr_set_level (old_level);
 }
 
 /* Frees the page at PAGE. */
@@ -155,15 +226,39 @@ palloc_free_page (void *page)
   palloc_free_multiple (page, 1);
 }
 
+/* Called by the idle thread to zero a free page and add it to
+   the pre-zeroed pages of a pool that has fewer than ZEROED_MAX
+   of them.  Returns true if it did so, false if there was nothing
+   to do. */
+bool
+palloc_zero_idle (void) 
+{
+  return zero_page (&kernel_pool) || zero_page (&user_pool);
+}
+
+/* Prints page allocator statistics. */
+void
+palloc_print_stats (void) 
+{
+  printf ("Palloc: %lld pre-zeroed page hits, %lld misses\n",
+          zeroed_hits, zeroed_misses);
+}
+
 /* Initializes pool P as starting at START and ending at END,
    naming it NAME for debugging purposes. */
 static void
 init_pool (struct pool *p, void *base, size_t page_cnt, const char *name) 
 {
-  /* We'll put the pool's used_map at its base.
-     Calculate the space needed for the bitmap
-     and subtract it from the pool's size. */
-  size_t bm_pages = DIV_ROUND_UP (bitmap_buf_size (page_cnt), PGSIZE);
+  /* We'll put the pool's buddy_page array and used_map at its
+     base.  Calculate the space needed for them and subtract it
+     from the pool's size. */
+  size_t pages_size = ROUND_UP (page_cnt * sizeof *p->pages,
+                                sizeof (unsigned long));
+  size_t bm_pages = DIV_ROUND_UP (pages_size + bitmap_buf_size (page_cnt),
+                                  PGSIZE);
+  size_t i;
+  int order;
+
   if (bm_pages > page_cnt)
     PANIC ("Not enough memory in %s for bitmap.", name);
   page_cnt -= bm_pages;
@@ -171,9 +266,19 @@ init_pool (struct pool *p, void *base, size_t page_cnt, const char *name)
   printf ("%zu pages available in %s.\n", page_cnt, name);
 
   /* Initialize the pool. */
-  lock_init (&p->lock);
-  p->used_map = bitmap_create_in_buf (page_cnt, base, bm_pages * PGSIZE);
+  p->pages = base;
+  p->used_map = bitmap_create_in_buf (page_cnt, (uint8_t *) base + pages_size,
+                                      bm_pages * PGSIZE - pages_size);
   p->base = base + bm_pages * PGSIZE;
+  for (order = 0; order < BUDDY_ORDERS; order++)
+    list_init (&p->free_lists[order]);
+  list_init (&p->zeroed);
+  p->zeroed_cnt = 0;
+  for (i = 0; i < page_cnt; i++)
+    p->pages[i].order = -1;
+
+  /* Every page starts out free. */
+  buddy_free (p, 0, page_cnt);
 }
 
 /* Returns true if PAGE was allocated from POOL,
@@ -187,3 +292,177 @@ page_from_pool (const struct pool *pool, void *page)
 
   return page_no >= start_page && page_no < end_page;
 }
+
+/* Returns the number of pages in POOL. */
+static size_t
+pool_size (const struct pool *pool) 
+{
+  return bitmap_size (pool->used_map);
+}
+
+/* Adds the free block of 2**ORDER pages at PAGE_IDX in POOL to
+   its free list. */
+static void
+push_block (struct pool *pool, size_t page_idx, int order) 
+{
+  pool->pages[page_idx].order = order;
+  list_push_front (&pool->free_lists[order], &pool->pages[page_idx].elem);
+}
+
+/* Removes the free block at PAGE_IDX in POOL from its free list. */
+static void
+remove_block (struct pool *pool, size_t page_idx) 
+{
+  list_remove (&pool->pages[page_idx].elem);
+  pool->pages[page_idx].order = -1;
+}
+
+/* Allocates PAGE_CNT contiguous pages in POOL and returns the
+   index of the first, or BITMAP_ERROR if no block is big enough.
+   Interrupts must be off. */
+static size_t
+buddy_alloc (struct pool *pool, size_t page_cnt) 
+{
+  int order, want;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  for (want = 0; ((size_t) 1 << want) < page_cnt; want++)
+    if (want == BUDDY_ORDERS - 1)
+      return BITMAP_ERROR;
+
+  for (order = want; order < BUDDY_ORDERS; order++)
+    if (!list_empty (&pool->free_lists[order])) 
+      {
+        struct buddy_page *bp
+          = list_entry (list_front (&pool->free_lists[order]),
+                        struct buddy_page, elem);
+        size_t page_idx = bp - pool->pages;
+
+        /* Split off upper halves until the block is the size
+           wanted, then give back the pages beyond PAGE_CNT. */
+        remove_block (pool, page_idx);
+        while (order > want) 
+          {
+            order--;
+            push_block (pool, page_idx + ((size_t) 1 << order), order);
+          }
+        buddy_free (pool, page_idx + page_cnt,
+                    ((size_t) 1 << want) - page_cnt);
+        return page_idx;
+      }
+  return BITMAP_ERROR;
+}
+
+/* Frees the single block of 2**ORDER pages at PAGE_IDX in POOL,
+   merging it with its buddy as long as possible. */
+static void
+free_block (struct pool *pool, size_t page_idx, int order) 
+{
+  size_t page_cnt = pool_size (pool);
+
+  while (order < BUDDY_ORDERS - 1) 
+    {
+      size_t buddy_idx = page_idx ^ ((size_t) 1 << order);
+      if (buddy_idx + ((size_t) 1 << order) > page_cnt
+          || pool->pages[buddy_idx].order != order)
+        break;
+      remove_block (pool, buddy_idx);
+      if (buddy_idx < page_idx)
+        page_idx = buddy_idx;
+      order++;
+    }
+  push_block (pool, page_idx, order);
+}
+
+/* Frees the PAGE_CNT pages starting at PAGE_IDX in POOL, which
+   need not form a single block.  Interrupts must be off, except
+   while the pool is being initialized. */
+static void
+buddy_free (struct pool *pool, size_t page_idx, size_t page_cnt) 
+{
+  while (page_cnt > 0) 
+    {
+      /* Largest block aligned at PAGE_IDX that fits. */
+      int order = 0;
+      while (order < BUDDY_ORDERS - 1
+             && (page_idx & ((size_t) 1 << order)) == 0
+             && ((size_t) 2 << order) <= page_cnt)
+        order++;
+
+      free_block (pool, page_idx, order);
+      page_idx += (size_t) 1 << order;
+      page_cnt -= (size_t) 1 << order;
+    }
+}
+
+/* Takes a page from POOL's pre-zeroed pages and returns it, or
+   returns a null pointer if there are none. */
+static void *
+get_zeroed_page (struct pool *pool) 
+{
+  struct buddy_page *bp = NULL;
+  enum intr_level old_level;
+
+  old_level = intr_disable ();
+  if (!list_empty (&pool->zeroed)) 
+    {
+      bp = list_entry (list_pop_front (&pool->zeroed),
+                       struct buddy_page, elem);
+      pool->zeroed_cnt--;
+      zeroed_hits++;
+    }
+  else
+    zeroed_misses++;
+  intr_set_level (old_level);
+
+  return bp != NULL ? pool->base + PGSIZE * (bp - pool->pages) : NULL;
+}
+
+/* Gives all of POOL's pre-zeroed pages back to the buddy
+   allocator.  Interrupts must be off. */
+static void
+release_zeroed (struct pool *pool) 
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  while (!list_empty (&pool->zeroed)) 
+    {
+      struct buddy_page *bp = list_entry (list_pop_front (&pool->zeroed),
+                                          struct buddy_page, elem);
+      size_t page_idx = bp - pool->pages;
+
+      bitmap_reset (pool->used_map, page_idx);
+      buddy_free (pool, page_idx, 1);
+    }
+  pool->zeroed_cnt = 0;
+}
+
+/* Allocates a page from POOL, zeroes it with interrupts on, and
+   adds it to POOL's pre-zeroed pages.  Returns false without
+   doing anything if POOL already has ZEROED_MAX pre-zeroed pages
+   or no free pages. */
+static bool
+zero_page (struct pool *pool) 
+{
+  enum intr_level old_level;
+  size_t page_idx;
+
+  old_level = intr_disable ();
+  page_idx = (pool->zeroed_cnt < ZEROED_MAX
+              ? buddy_alloc (pool, 1) : BITMAP_ERROR);
+  if (page_idx != BITMAP_ERROR)
+    bitmap_mark (pool->used_map, page_idx);
+  intr_set_level (old_level);
+
+  if (page_idx == BITMAP_ERROR)
+    return false;
+
+  memset (pool->base + PGSIZE * page_idx, 0, PGSIZE);
+
+  old_level = intr_disable ();
+  list_push_back (&pool->zeroed, &pool->pages[page_idx].elem);
+  pool->zeroed_cnt++;
+  intr_set_level (old_level);
+  return true;
+}
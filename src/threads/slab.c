@@ -0,0 +1,301 @@
+#include "threads/slab.h"
+#include <debug.h>
+#include <list.h>
+#include <round.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/interrupt.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+
+/* A simple slab allocator, after Bonwick, "The Slab Allocator:
+   An Object-Caching Kernel Memory Allocator".
+
+   Each slab is a single page: a struct slab header, followed by
+   a stack of the indexes of its free objects, followed by the
+   objects themselves.  Keeping the free objects' indexes outside
+   the objects, instead of threading a free list through them,
+   is what lets freed objects keep their constructed state.
+
+   A cache keeps its slabs on three lists, according to whether
+   they are partly used, full, or empty.  Allocation takes from a
+   partly used slab if there is one, so that objects are packed
+   into as few slabs as possible.  At most one empty slab is kept
+   around to absorb alloc/free cycles at the boundary; any other
+   slab that becomes empty goes back to the page allocator. */
+
+/* An object cache. */
+struct kmem_cache
+  {
+    struct list_elem elem;      /* Element in all_caches. */
+    const char *name;           /* Name, for statistics. */
+    size_t obj_size;            /* Size of each object in bytes. */
+    size_t objs_per_slab;       /* Number of objects in a slab. */
+    size_t objs_ofs;            /* Offset of first object in a slab. */
+    kmem_ctor *ctor;            /* Constructor, or null. */
+    struct lock lock;           /* Protects everything below. */
+    struct list partial_slabs;  /* Slabs with used and free objects. */
+    struct list full_slabs;     /* Slabs with no free objects. */
+    struct list empty_slabs;    /* Slabs with no used objects. */
+
+    /* Statistics. */
+    size_t slab_cnt;            /* Current number of slabs. */
+    size_t max_slab_cnt;        /* Largest SLAB_CNT so far. */
+    size_t in_use;              /* Current number of allocated objects. */
+    size_t max_in_use;          /* Largest IN_USE so far. */
+    long long alloc_cnt;        /* Number of kmem_cache_alloc() calls. */
+  };
+
+/* Magic number for detecting slab corruption. */
+#define SLAB_MAGIC 0x51ab51ab
+
+/* A slab, at the beginning of its page. */
+struct slab
+  {
+    unsigned magic;             /* Always set to SLAB_MAGIC. */
+    struct kmem_cache *cache;   /* Owning cache. */
+    struct list_elem elem;      /* Element in one of cache's lists. */
+    size_t free_cnt;            /* Number of free objects. */
+    uint16_t free_idx[];        /* Indexes of free objects. */
+  };
+
+/* Objects are aligned to this many bytes. */
+#define SLAB_ALIGN sizeof (void *)
+
+/* List of all caches, for statistics.
+   Changed only with interrupts off. */
+static struct list all_caches;
+
+static struct slab *slab_create (struct kmem_cache *);
+static void *slab_obj (struct slab *, size_t idx);
+static struct slab *obj_to_slab (struct kmem_cache *, void *);
+
+/* Initializes the slab allocator. */
+void
+kmem_init (void) 
+{
+  list_init (&all_caches);
+}
+
+/* Creates and returns a new cache of objects SIZE bytes long,
+   named NAME, whose objects are initialized by CTOR if it is
+   nonnull.  Returns a null pointer if memory is not available.
+   SIZE must be small enough that a few objects fit in a page;
+   bigger objects should be allocated with malloc().
+
+   Caches cannot be destroyed, which is fine because they are
+   meant to be created once, when a subsystem is initialized. */
+struct kmem_cache *
+kmem_cache_create (const char *name, size_t size, kmem_ctor *ctor) 
+{
+  struct kmem_cache *c;
+  enum intr_level old_level;
+
+  ASSERT (name != NULL);
+  ASSERT (size > 0 && size <= PGSIZE / 4);
+
+  c = malloc (sizeof *c);
+  if (c == NULL)
+    return NULL;
+
+  c->name = name;
+  c->obj_size = ROUND_UP (size, SLAB_ALIGN);
+  c->ctor = ctor;
+
+  /* Fit as many objects as possible into a page along with the
+     header and the free index stack. */
+  c->objs_per_slab = ((PGSIZE - sizeof (struct slab))
+                      / (c->obj_size + sizeof (uint16_t)));
+  for (;;) 
+    {
+      c->objs_ofs = ROUND_UP (sizeof (struct slab)
+                              + c->objs_per_slab * sizeof (uint16_t),
+                              SLAB_ALIGN);
+      if (c->objs_ofs + c->objs_per_slab * c->obj_size <= PGSIZE)
+        break;
+      c->objs_per_slab--;
+    }
+  ASSERT (c->objs_per_slab > 0);
+
+  lock_init (&c->lock);
+  list_init (&c->partial_slabs);
+  list_init (&c->full_slabs);
+  list_init (&c->empty_slabs);
+  c->slab_cnt = c->max_slab_cnt = 0;
+  c->in_use = c->max_in_use = 0;
+  c->alloc_cnt = 0;
+
+  old_level = intr_disable ();
+  list_push_back (&all_caches, &c->elem);
+  intr_set_level (old_level);
+
+  return c;
+}
+
+/* Allocates and returns an object from cache C.
+   Returns a null pointer if memory is not available. */
+void *
+kmem_cache_alloc (struct kmem_cache *c) 
+{
+  struct slab *s;
+  void *obj;
+
+  ASSERT (c != NULL);
+
+  lock_acquire (&c->lock);
+  if (!list_empty (&c->partial_slabs))
+    s = list_entry (list_front (&c->partial_slabs), struct slab, elem);
+  else if (!list_empty (&c->empty_slabs)) 
+    {
+      s = list_entry (list_pop_front (&c->empty_slabs), struct slab, elem);
+      list_push_front (&c->partial_slabs, &s->elem);
+    }
+  else 
+    {
+      s = slab_create (c);
+      if (s == NULL) 
+        {
+          lock_release (&c->lock);
+          return NULL;
+        }
+      list_push_front (&c->partial_slabs, &s->elem);
+    }
+
+  obj = slab_obj (s, s->free_idx[--s->free_cnt]);
+  if (s->free_cnt == 0) 
+    {
+      list_remove (&s->elem);
+      list_push_front (&c->full_slabs, &s->elem);
+    }
+
+  c->alloc_cnt++;
+  if (++c->in_use > c->max_in_use)
+    c->max_in_use = c->in_use;
+  lock_release (&c->lock);
+
+  return obj;
+}
+
+/* Returns OBJ, which must have been allocated from cache C, to
+   C. */
+void
+kmem_cache_free (struct kmem_cache *c, void *obj) 
+{
+  struct slab *s;
+
+  ASSERT (c != NULL);
+  if (obj == NULL)
+    return;
+
+  s = obj_to_slab (c, obj);
+
+#ifndef NDEBUG
+  /* Clear the object to help detect use-after-free bugs, unless
+     it has to keep its constructed state. */
+  if (c->ctor == NULL)
+    memset (obj, 0xcc, c->obj_size);
+#endif
+
+  lock_acquire (&c->lock);
+  ASSERT (s->free_cnt < c->objs_per_slab);
+  s->free_idx[s->free_cnt++] = ((uint8_t *) obj - (uint8_t *) s
+                                - c->objs_ofs) / c->obj_size;
+  c->in_use--;
+
+  if (s->free_cnt == 1 || s->free_cnt == c->objs_per_slab) 
+    {
+      /* Move S from the full list to the partial list, or from
+         the partial list to the empty list. */
+      list_remove (&s->elem);
+      if (s->free_cnt < c->objs_per_slab)
+        list_push_front (&c->partial_slabs, &s->elem);
+      else if (list_empty (&c->empty_slabs))
+        list_push_front (&c->empty_slabs, &s->elem);
+      else 
+        {
+          s->magic = 0;
+          palloc_free_page (s);
+          c->slab_cnt--;
+        }
+    }
+  lock_release (&c->lock);
+}
+
+/* Prints statistics for each cache. */
+void
+kmem_print_stats (void) 
+{
+  struct list_elem *e;
+
+  for (e = list_begin (&all_caches); e != list_end (&all_caches);
+       e = list_next (e)) 
+    {
+      struct kmem_cache *c = list_entry (e, struct kmem_cache, elem);
+
+      printf ("Slab %s: %zu-byte objects, %zu per slab, "
+              "%zu in use (%zu peak), %zu slabs (%zu peak), %lld allocs\n",
+              c->name, c->obj_size, c->objs_per_slab,
+              c->in_use, c->max_in_use, c->slab_cnt, c->max_slab_cnt,
+              c->alloc_cnt);
+    }
+}
+
+/* Allocates a new slab for cache C and constructs its objects.
+   Returns a null pointer if memory is not available.
+   C's lock must be held. */
+static struct slab *
+slab_create (struct kmem_cache *c) 
+{
+  struct slab *s;
+  size_t i;
+
+  ASSERT (lock_held_by_current_thread (&c->lock));
+
+  s = palloc_get_page (0);
+  if (s == NULL)
+    return NULL;
+
+  s->magic = SLAB_MAGIC;
+  s->cache = c;
+  s->free_cnt = c->objs_per_slab;
+
+  /* Hand out low addresses first. */
+  for (i = 0; i < c->objs_per_slab; i++) 
+    {
+      s->free_idx[i] = c->objs_per_slab - i - 1;
+      if (c->ctor != NULL)
+        c->ctor (slab_obj (s, i));
+    }
+
+  if (++c->slab_cnt > c->max_slab_cnt)
+    c->max_slab_cnt = c->slab_cnt;
+  return s;
+}
+
+/* Returns the IDX'th object in slab S. */
+static void *
+slab_obj (struct slab *s, size_t idx) 
+{
+  ASSERT (idx < s->cache->objs_per_slab);
+  return (uint8_t *) s + s->cache->objs_ofs + idx * s->cache->obj_size;
+}
+
+/* Returns the slab that OBJ, an object in cache C, is inside. */
+static struct slab *
+obj_to_slab (struct kmem_cache *c, void *obj) 
+{
+  struct slab *s = pg_round_down (obj);
+
+  /* Check that the slab is valid and belongs to C. */
+  ASSERT (s->magic == SLAB_MAGIC);
+  ASSERT (s->cache == c);
+
+  /* Check that the object is properly aligned within the slab. */
+  ASSERT (pg_ofs (obj) >= c->objs_ofs);
+  ASSERT ((pg_ofs (obj) - c->objs_ofs) % c->obj_size == 0);
+
+  return s;
+}
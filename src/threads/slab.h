@@ -0,0 +1,32 @@
+#ifndef THREADS_SLAB_H
+#define THREADS_SLAB_H
+
+#include <stddef.h>
+
+/* Object caches.
+
+   malloc() rounds every request up to a power of 2, which wastes
+   up to half of each block: a struct inode, which holds a
+   512-byte inode_disk, occupies a 1024-byte block.  An object
+   cache instead hands out objects of one exact size, packed into
+   pages called "slabs".
+
+   If a cache has a constructor, it is run on each object once,
+   when the object's slab is created, not on every allocation.
+   Objects must therefore be returned to kmem_cache_free() in
+   their constructed state, e.g. with any embedded locks
+   released. */
+
+/* Constructor for the objects in a cache. */
+typedef void kmem_ctor (void *obj);
+
+struct kmem_cache;
+
+void kmem_init (void);
+struct kmem_cache *kmem_cache_create (const char *name, size_t size,
+                                      kmem_ctor *);
+void *kmem_cache_alloc (struct kmem_cache *);
+void kmem_cache_free (struct kmem_cache *, void *);
+void kmem_print_stats (void);
+
+#endif /* threads/slab.h */
@@ -27,10 +27,27 @@
 */
 
 #include "threads/synch.h"
+#include <inttypes.h>
 #include <stdio.h>
 #include <string.h>
 #include "threads/interrupt.h"
 #include "threads/thread.h"
+#include "threads/tsc.h"
+#include "devices/timer.h"
+
+#ifdef LOCK_PROFILE
+/* Define the functions themselves, not the macros in synch.h
+   that give each call site its own lock class. */
+#undef lock_init
+#undef rwlock_init
+
+static void profile_wait (struct lock_class *, uint64_t start,
+                          bool contended);
+static void profile_hold (struct lock_class *, uint64_t acquired);
+#endif
+
+static void sema_wake (struct semaphore *);
+static void lock_drop (struct lock *);
 
 /* Initializes semaphore SEMA to VALUE.  A semaphore is a
    nonnegative integer along with two atomic operators for
@@ -102,7 +119,10 @@ sema_try_down (struct semaphore *sema)
 }
 
 /* Up or "V" operation on a semaphore.  Increments SEMA's value
-   and wakes up one thread of those waiting for SEMA, if any.
+   and wakes up the highest priority thread of those waiting for
+   SEMA, if any.
+   If the woken thread has a higher priority than the running
+   thread, the running thread yields to it.
 
    This function may be called from an interrupt handler. */
 void
@@ -113,11 +133,28 @@ sema_up (struct semaphore *sema)
   ASSERT (sema != NULL);
 
   old_level = intr_disable ();
+  sema_wake (sema);
+  intr_set_level (old_level);
+
+  thread_preempt ();
+}
+
+/* Does the work of sema_up() except for yielding to the woken
+   thread, which is left to the caller.  Interrupts must be
+   off. */
+static void
+sema_wake (struct semaphore *sema) 
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
   if (!list_empty (&sema->waiters)) 
-    thread_unblock (list_entry (list_pop_front (&sema->waiters),
-                                struct thread, elem));
+    {
+      struct list_elem *e = list_max (&sema->waiters,
+                                      thread_priority_less, NULL);
+      list_remove (e);
+      thread_unblock (list_entry (e, struct thread, elem));
+    }
   sema->value++;
-  intr_set_level (old_level);
 }
 
 static void sema_test_helper (void *sema_);
@@ -179,12 +216,50 @@ lock_init (struct lock *lock)
 
   lock->holder = NULL;
   sema_init (&lock->semaphore, 1);
+#ifdef LOCK_PROFILE
+  lock->class = NULL;
+#endif
+}
+
+/* Maximum length of a chain of lock holders that a donation is
+   passed along.  Bounds the work done in lock_acquire() and
+   protects against runaway loops in case of deadlock. */
+#define DONATION_DEPTH 8
+
+/* Donates the current thread's priority to the holder of LOCK,
+   which the current thread is about to wait for.  If that holder
+   is itself waiting for a lock, the donation is passed on to its
+   holder, and so on (nested donation).  Interrupts must be
+   off. */
+static void
+donate_priority (struct lock *lock) 
+{
+  int priority = thread_current ()->priority;
+  int depth;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  for (depth = 0; lock != NULL && lock->holder != NULL
+                  && depth < DONATION_DEPTH; depth++)
+    {
+      struct thread *holder = lock->holder;
+      if (holder->priority >= priority)
+        break;
+      thread_raise_priority (holder, priority);
+      lock = holder->waiting_lock;
+    }
 }
 
 /* Acquires LOCK, sleeping until it becomes available if
    necessary.  The lock must not already be held by the current
    thread.
 
+   While waiting, the current thread donates its priority to the
+   lock's holder, so that a lower priority holder cannot be
+   starved by medium priority threads (priority inversion).
+   Donation is not used with the multi-level feedback queue
+   scheduler.
+
    This function may sleep, so it must not be called within an
    interrupt handler.  This function may be called with
    interrupts disabled, but interrupts will be turned back on if
@@ -192,12 +267,36 @@ lock_init (struct lock *lock)
 void
 lock_acquire (struct lock *lock)
 {
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+#ifdef LOCK_PROFILE
+  uint64_t start;
+  bool contended;
+#endif
+
   ASSERT (lock != NULL);
   ASSERT (!intr_context ());
   ASSERT (!lock_held_by_current_thread (lock));
 
+  old_level = intr_disable ();
+#ifdef LOCK_PROFILE
+  start = read_tsc ();
+  contended = lock->semaphore.value == 0;
+#endif
+  if (lock->holder != NULL && !thread_mlfqs)
+    {
+      cur->waiting_lock = lock;
+      donate_priority (lock);
+    }
   sema_down (&lock->semaphore);
-  lock->holder = thread_current ();
+  cur->waiting_lock = NULL;
+  lock->holder = cur;
+  list_push_back (&cur->held_locks, &lock->elem);
+#ifdef LOCK_PROFILE
+  profile_wait (lock->class, start, contended);
+  lock->acquired = read_tsc ();
+#endif
+  intr_set_level (old_level);
 }
 
 /* Tries to acquires LOCK and returns true if successful or false
@@ -216,11 +315,21 @@ lock_try_acquire (struct lock *lock)
 
   success = sema_try_down (&lock->semaphore);
   if (success)
-    lock->holder = thread_current ();
+    {
+      enum intr_level old_level = intr_disable ();
+      lock->holder = thread_current ();
+      list_push_back (&lock->holder->held_locks, &lock->elem);
+#ifdef LOCK_PROFILE
+      lock->acquired = read_tsc ();
+      profile_wait (lock->class, lock->acquired, false);
+#endif
+      intr_set_level (old_level);
+    }
   return success;
 }
 
 /* Releases LOCK, which must be owned by the current thread.
+   Gives up any priority donated through LOCK.
 
    An interrupt handler cannot acquire a lock, so it does not
    make sense to try to release a lock within an interrupt
@@ -228,11 +337,35 @@ lock_try_acquire (struct lock *lock)
 void
 lock_release (struct lock *lock) 
 {
+  enum intr_level old_level;
+
   ASSERT (lock != NULL);
   ASSERT (lock_held_by_current_thread (lock));
 
+  old_level = intr_disable ();
+  lock_drop (lock);
+  intr_set_level (old_level);
+
+  thread_preempt ();
+}
+
+/* Does the work of lock_release() except for yielding to the
+   thread that it wakes, which is left to the caller.  Interrupts
+   must be off. */
+static void
+lock_drop (struct lock *lock) 
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (lock_held_by_current_thread (lock));
+
+#ifdef LOCK_PROFILE
+  profile_hold (lock->class, lock->acquired);
+#endif
   lock->holder = NULL;
-  sema_up (&lock->semaphore);
+  list_remove (&lock->elem);
+  if (!thread_mlfqs)
+    thread_update_priority (thread_current ());
+  sema_wake (&lock->semaphore);
 }
 
 /* Returns true if the current thread holds LOCK, false
@@ -246,13 +379,29 @@ lock_held_by_current_thread (const struct lock *lock)
   return lock->holder == thread_current ();
 }
 
-/* One semaphore in a list. */
-struct semaphore_elem 
+/* One thread waiting on a condition variable. */
+struct cond_waiter 
   {
-    struct list_elem elem;              /* List element. */
-    struct semaphore semaphore;         /* This semaphore. */
+    struct list_elem elem;              /* Element in condition's list. */
+    struct thread *thread;              /* Waiting thread. */
+    bool signaled;                      /* Moved to the lock's queue? */
   };
 
+/* Orders cond_waiters by the priority of their waiting threads. */
+static bool
+cond_waiter_less (const struct list_elem *a_, const struct list_elem *b_,
+                  void *aux UNUSED) 
+{
+  const struct cond_waiter *a = list_entry (a_, struct cond_waiter, elem);
+  const struct cond_waiter *b = list_entry (b_, struct cond_waiter, elem);
+
+  return a->thread->priority < b->thread->priority;
+}
+
+static bool cond_sleep (struct condition *, struct lock *, int64_t ticks);
+static void cond_morph (struct cond_waiter *, struct lock *);
+static alarm_func cond_timeout;
+
 /* Initializes condition variable COND.  A condition variable
    allows one piece of code to signal a condition and cooperating
    code to receive the signal and act upon it. */
@@ -287,38 +436,133 @@ cond_init (struct condition *cond)
 void
 cond_wait (struct condition *cond, struct lock *lock) 
 {
-  struct semaphore_elem waiter;
+  cond_sleep (cond, lock, 0);
+}
+
+/* Like cond_wait(), but gives up waiting for COND after
+   approximately TICKS timer ticks.  LOCK is reacquired before
+   returning in either case.  Returns true if COND was signaled,
+   false if the wait timed out.  If TICKS is 0 or less, returns
+   false immediately, without releasing LOCK. */
+bool
+cond_wait_timeout (struct condition *cond, struct lock *lock, int64_t ticks) 
+{
+  if (ticks <= 0)
+    return false;
+  return cond_sleep (cond, lock, ticks);
+}
+
+/* Waits for COND on behalf of cond_wait() and
+   cond_wait_timeout(), giving up after TICKS timer ticks if TICKS
+   is positive.  Returns true if COND was signaled.
+
+   A signaled waiter is not woken up.  Instead, it is moved onto
+   LOCK's queue of waiters ("wait morphing"), where it is treated
+   exactly like a thread blocked in lock_acquire().  It runs only
+   once the signaling thread releases LOCK, so that it does not
+   wake up just to block again on LOCK, and cond_broadcast()
+   doesn't set off a stampede of threads all but one of which go
+   right back to sleep. */
+static bool
+cond_sleep (struct condition *cond, struct lock *lock, int64_t ticks) 
+{
+  struct cond_waiter waiter;
+  struct alarm alarm;
+  enum intr_level old_level;
 
   ASSERT (cond != NULL);
   ASSERT (lock != NULL);
   ASSERT (!intr_context ());
   ASSERT (lock_held_by_current_thread (lock));
-  
-  sema_init (&waiter.semaphore, 0);
+
+  old_level = intr_disable ();
+  waiter.thread = thread_current ();
+  waiter.signaled = false;
   list_push_back (&cond->waiters, &waiter.elem);
-  lock_release (lock);
-  sema_down (&waiter.semaphore);
+  if (ticks > 0) 
+    {
+      alarm_init (&alarm, cond_timeout, &waiter);
+      alarm_set (&alarm, timer_ticks () + ticks);
+    }
+  lock_drop (lock);
+
+  /* Woken by lock_release() once signaled, or by cond_timeout(). */
+  thread_block ();
+  if (ticks > 0)
+    alarm_cancel (&alarm);
+  intr_set_level (old_level);
+
   lock_acquire (lock);
+  return waiter.signaled;
+}
+
+/* Moves WAITER, which must be on its condition's list, onto the
+   queue of threads waiting for LOCK, which the current thread
+   holds.  Interrupts must be off. */
+static void
+cond_morph (struct cond_waiter *waiter, struct lock *lock) 
+{
+  struct thread *t = waiter->thread;
+  struct thread *cur = thread_current ();
+
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (!waiter->signaled);
+
+  list_remove (&waiter->elem);
+  waiter->signaled = true;
+  list_push_back (&lock->semaphore.waiters, &t->elem);
+
+  /* The waiter is now waiting for LOCK, so it donates its
+     priority to us, LOCK's holder, as in lock_acquire(). */
+  if (!thread_mlfqs) 
+    {
+      t->waiting_lock = lock;
+      if (t->priority > cur->priority)
+        thread_raise_priority (cur, t->priority);
+    }
+}
+
+/* Alarm function for cond_wait_timeout(): wakes up WAITER_ if it
+   is still waiting for its condition. */
+static void
+cond_timeout (void *waiter_) 
+{
+  struct cond_waiter *waiter = waiter_;
+
+  if (!waiter->signaled) 
+    {
+      list_remove (&waiter->elem);
+      thread_unblock (waiter->thread);
+      thread_preempt ();
+    }
 }
 
 /* If any threads are waiting on COND (protected by LOCK), then
-   this function signals one of them to wake up from its wait.
+   this function signals the highest priority one of them to wake
+   up from its wait.
    LOCK must be held before calling this function.
 
    An interrupt handler cannot acquire a lock, so it does not
    make sense to try to signal a condition variable within an
    interrupt handler. */
 void
-cond_signal (struct condition *cond, struct lock *lock UNUSED) 
+cond_signal (struct condition *cond, struct lock *lock) 
 {
+  enum intr_level old_level;
+
   ASSERT (cond != NULL);
   ASSERT (lock != NULL);
   ASSERT (!intr_context ());
   ASSERT (lock_held_by_current_thread (lock));
 
+  old_level = intr_disable ();
   if (!list_empty (&cond->waiters)) 
-    sema_up (&list_entry (list_pop_front (&cond->waiters),
-                          struct semaphore_elem, elem)->semaphore);
+    {
+      struct list_elem *e = list_max (&cond->waiters,
+                                      cond_waiter_less, NULL);
+      cond_morph (list_entry (e, struct cond_waiter, elem), lock);
+    }
+  intr_set_level (old_level);
 }
 
 /* Wakes up all threads, if any, waiting on COND (protected by
@@ -330,64 +574,425 @@ cond_signal (struct condition *cond, struct lock *lock UNUSED)
 void
 cond_broadcast (struct condition *cond, struct lock *lock) 
 {
+  enum intr_level old_level;
+
   ASSERT (cond != NULL);
   ASSERT (lock != NULL);
+  ASSERT (!intr_context ());
+  ASSERT (lock_held_by_current_thread (lock));
 
+  old_level = intr_disable ();
   while (!list_empty (&cond->waiters))
-    cond_signal (cond, lock);
+    cond_morph (list_entry (list_front (&cond->waiters),
+                            struct cond_waiter, elem), lock);
+  intr_set_level (old_level);
 }
 
+/* One thread waiting in a struct rwlock's read_waiters or
+   write_waiters list. */
+struct rwlock_waiter 
+  {
+    struct list_elem elem;      /* List element. */
+    struct thread *thread;      /* Waiting thread. */
+  };
+
+static void rwlock_wait (struct list *waiters);
+static void rwlock_wake_readers (struct rwlock *);
+static void rwlock_wake_writer (struct rwlock *);
+static void rwlock_hold_begin (struct rwlock *);
+static void rwlock_hold_end (struct rwlock *);
+
+/* Initializes readers-writer lock RW. */
 void
 rwlock_init (struct rwlock *rw)
 {
   ASSERT (rw != NULL);
 
-  lock_init (&rw->mutex);
-  sema_init (&rw->wrt, 1);
-  rw->readcount = 0;
+  rw->readers = 0;
+  rw->writer = NULL;
+  rw->upgrader = NULL;
+  list_init (&rw->read_waiters);
+  list_init (&rw->write_waiters);
+#ifdef LOCK_PROFILE
+  rw->class = NULL;
+#endif
 }
 
+/* Acquires RW for reading, sleeping until no writer holds it or
+   is waiting for it.  RW must not already be held by the current
+   thread.
+
+   This function may sleep, so it must not be called within an
+   interrupt handler. */
 void
 rwlock_reader_lock (struct rwlock *rw)
 {
-  ASSERT (rw != NULL);
-
-  lock_acquire (&rw->mutex);
+  enum intr_level old_level;
+#ifdef LOCK_PROFILE
+  uint64_t start;
+  bool contended = true;
+#endif
 
-  if (++rw->readcount == 1)
-    sema_down (&rw->wrt);
+  ASSERT (rw != NULL);
+  ASSERT (!intr_context ());
+  ASSERT (rw->writer != thread_current ());
 
-  lock_release (&rw->mutex);
+  old_level = intr_disable ();
+#ifdef LOCK_PROFILE
+  start = read_tsc ();
+#endif
+  if (rw->writer == NULL && rw->upgrader == NULL
+      && list_empty (&rw->write_waiters)) 
+    {
+      if (rw->readers++ == 0)
+        rwlock_hold_begin (rw);
+#ifdef LOCK_PROFILE
+      contended = false;
+#endif
+    }
+  else
+    rwlock_wait (&rw->read_waiters);
+#ifdef LOCK_PROFILE
+  profile_wait (rw->class, start, contended);
+#endif
+  intr_set_level (old_level);
 }
 
+/* Releases RW, which the current thread must hold for reading.
+   The last reader to leave hands the lock to a waiting upgrader
+   or, failing that, to the first waiting writer. */
 void
 rwlock_reader_unlock (struct rwlock *rw)
 {
-  ASSERT (rw != NULL);
-
-  lock_acquire (&rw->mutex);
+  enum intr_level old_level;
 
-  if (--rw->readcount == 0)
-    sema_up (&rw->wrt);
+  ASSERT (rw != NULL);
+  ASSERT (rw->readers > 0);
 
-  lock_release (&rw->mutex);
+  old_level = intr_disable ();
+  if (--rw->readers == 0) 
+    {
+      rwlock_hold_end (rw);
+      rwlock_wake_writer (rw);
+    }
+  intr_set_level (old_level);
+  thread_preempt ();
 }
 
+/* Acquires RW for writing, sleeping until it is free and every
+   writer that asked for it earlier has had its turn.  RW must not
+   already be held by the current thread.
+
+   This function may sleep, so it must not be called within an
+   interrupt handler. */
 void
 rwlock_writer_lock (struct rwlock *rw)
 {
+  enum intr_level old_level;
+#ifdef LOCK_PROFILE
+  uint64_t start;
+  bool contended = true;
+#endif
+
   ASSERT (rw != NULL);
+  ASSERT (!intr_context ());
+  ASSERT (rw->writer != thread_current ());
 
-  sema_down (&rw->wrt);
+  old_level = intr_disable ();
+#ifdef LOCK_PROFILE
+  start = read_tsc ();
+#endif
+  if (rw->writer == NULL && rw->readers == 0 && rw->upgrader == NULL
+      && list_empty (&rw->write_waiters)) 
+    {
+      rw->writer = thread_current ();
+      rwlock_hold_begin (rw);
+#ifdef LOCK_PROFILE
+      contended = false;
+#endif
+    }
+  else
+    rwlock_wait (&rw->write_waiters);
+  ASSERT (rw->writer == thread_current ());
+#ifdef LOCK_PROFILE
+  profile_wait (rw->class, start, contended);
+#endif
+  intr_set_level (old_level);
 }
 
+/* Releases RW, which the current thread must hold for writing.
+   Every waiting reader gets the lock at once, if there are any;
+   otherwise the first waiting writer gets it. */
 void
 rwlock_writer_unlock (struct rwlock *rw)
 {
+  enum intr_level old_level;
+
+  ASSERT (rw != NULL);
+  ASSERT (rw->writer == thread_current ());
+
+  old_level = intr_disable ();
+  rwlock_hold_end (rw);
+  rw->writer = NULL;
+  if (!list_empty (&rw->read_waiters))
+    rwlock_wake_readers (rw);
+  else
+    rwlock_wake_writer (rw);
+  intr_set_level (old_level);
+  thread_preempt ();
+}
+
+/* Converts the current thread's read lock on RW into a write
+   lock, sleeping until the other readers have left.  No writer
+   can get RW in between, so whatever the caller read under the
+   read lock is still valid once it holds the write lock.
+
+   Only one reader at a time can upgrade.  If another reader is
+   already waiting to upgrade, returns false without sleeping, and
+   the caller still holds its read lock; it should release it so
+   that the other upgrade can finish.  Otherwise returns true.
+
+   This function may sleep, so it must not be called within an
+   interrupt handler. */
+bool
+rwlock_upgrade (struct rwlock *rw)
+{
+  enum intr_level old_level;
+
   ASSERT (rw != NULL);
+  ASSERT (!intr_context ());
+  ASSERT (rw->readers > 0);
+
+  old_level = intr_disable ();
+  if (rw->upgrader != NULL) 
+    {
+      intr_set_level (old_level);
+      return false;
+    }
+  if (--rw->readers == 0) 
+    {
+      rwlock_hold_end (rw);
+      rw->writer = thread_current ();
+      rwlock_hold_begin (rw);
+    }
+  else 
+    {
+      rw->upgrader = thread_current ();
+      thread_block ();
+    }
+  ASSERT (rw->writer == thread_current ());
+  intr_set_level (old_level);
+  return true;
+}
+
+/* Converts the current thread's write lock on RW into a read
+   lock.  Readers waiting for RW get it too. */
+void
+rwlock_downgrade (struct rwlock *rw)
+{
+  enum intr_level old_level;
+
+  ASSERT (rw != NULL);
+  ASSERT (rw->writer == thread_current ());
+
+  old_level = intr_disable ();
+  rwlock_hold_end (rw);
+  rw->writer = NULL;
+  rw->readers++;
+  rwlock_hold_begin (rw);
+  rwlock_wake_readers (rw);
+  intr_set_level (old_level);
+  thread_preempt ();
+}
+
+/* Puts the current thread on WAITERS and blocks it until a
+   releasing thread hands it the lock.  Interrupts must be off. */
+static void
+rwlock_wait (struct list *waiters) 
+{
+  struct rwlock_waiter waiter;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  waiter.thread = thread_current ();
+  list_push_back (waiters, &waiter.elem);
+  thread_block ();
+}
+
+/* Hands RW to every thread waiting to read it, all at once.
+   Interrupts must be off. */
+static void
+rwlock_wake_readers (struct rwlock *rw) 
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (rw->readers == 0 && !list_empty (&rw->read_waiters))
+    rwlock_hold_begin (rw);
+  while (!list_empty (&rw->read_waiters)) 
+    {
+      struct list_elem *e = list_pop_front (&rw->read_waiters);
+      rw->readers++;
+      thread_unblock (list_entry (e, struct rwlock_waiter, elem)->thread);
+    }
+}
+
+/* Hands RW, which no thread now holds, to the waiting upgrader or
+   else to the first waiting writer, if any.  Interrupts must be
+   off. */
+static void
+rwlock_wake_writer (struct rwlock *rw) 
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (rw->readers == 0 && rw->writer == NULL);
+
+  if (rw->upgrader != NULL) 
+    {
+      rw->writer = rw->upgrader;
+      rw->upgrader = NULL;
+      rwlock_hold_begin (rw);
+      thread_unblock (rw->writer);
+    }
+  else if (!list_empty (&rw->write_waiters)) 
+    {
+      struct list_elem *e = list_pop_front (&rw->write_waiters);
+      rw->writer = list_entry (e, struct rwlock_waiter, elem)->thread;
+      rwlock_hold_begin (rw);
+      thread_unblock (rw->writer);
+    }
+}
+
+/* Notes that RW, which was free, is now held by a writer or by a
+   group of readers.  Interrupts must be off. */
+static void
+rwlock_hold_begin (struct rwlock *rw UNUSED) 
+{
+#ifdef LOCK_PROFILE
+  rw->acquired = read_tsc ();
+#endif
+}
 
-  sema_up (&rw->wrt);
+/* Notes that RW's writer, or its last reader, is giving it up.
+   Interrupts must be off. */
+static void
+rwlock_hold_end (struct rwlock *rw UNUSED) 
+{
+#ifdef LOCK_PROFILE
+  profile_hold (rw->class, rw->acquired);
+#endif
 }
+
+#ifdef LOCK_PROFILE
+/* List of every lock_class used so far.  Changed only with
+   interrupts off. */
+static struct list lock_classes;
+static bool lock_classes_initialized;
 
-  
+/* Adds CLASS to lock_classes, if it is not there already. */
+static void
+register_class (struct lock_class *class) 
+{
+  enum intr_level old_level = intr_disable ();
+  if (!lock_classes_initialized) 
+    {
+      list_init (&lock_classes);
+      lock_classes_initialized = true;
+    }
+  if (!class->registered) 
+    {
+      list_push_back (&lock_classes, &class->elem);
+      class->registered = true;
+    }
+  intr_set_level (old_level);
+}
+
+/* Makes LOCK record its statistics in CLASS. */
+void
+lock_set_class (struct lock *lock, struct lock_class *class) 
+{
+  register_class (class);
+  lock->class = class;
+}
 
+/* Makes RW record its statistics in CLASS. */
+void
+rwlock_set_class (struct rwlock *rw, struct lock_class *class) 
+{
+  register_class (class);
+  rw->class = class;
+}
+
+/* Records in CLASS an acquisition that began at time START and
+   that had to wait if CONTENDED is true.  Interrupts must be
+   off. */
+static void
+profile_wait (struct lock_class *class, uint64_t start, bool contended) 
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (class != NULL) 
+    {
+      uint64_t wait = read_tsc () - start;
+
+      class->acquire_cnt++;
+      if (contended)
+        class->contended_cnt++;
+      class->wait_total += wait;
+      if (wait > class->wait_max)
+        class->wait_max = wait;
+    }
+}
+
+/* Records in CLASS a lock being released that was acquired at
+   time ACQUIRED.  Interrupts must be off. */
+static void
+profile_hold (struct lock_class *class, uint64_t acquired) 
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (class != NULL) 
+    {
+      uint64_t hold = read_tsc () - acquired;
+      if (hold > class->hold_max)
+        class->hold_max = hold;
+    }
+}
+
+/* Orders lock classes by descending total wait time. */
+static bool
+class_more_wait (const struct list_elem *a_, const struct list_elem *b_,
+                 void *aux UNUSED) 
+{
+  const struct lock_class *a = list_entry (a_, struct lock_class, elem);
+  const struct lock_class *b = list_entry (b_, struct lock_class, elem);
+
+  return a->wait_total > b->wait_total;
+}
+
+/* Prints the statistics of every lock class that was used, in
+   order of descending total wait time. */
+void
+lock_print_stats (void) 
+{
+  struct list_elem *e;
+
+  if (!lock_classes_initialized)
+    return;
+
+  list_sort (&lock_classes, class_more_wait, NULL);
+  printf ("Lock profile (times in CPU cycles):\n");
+  for (e = list_begin (&lock_classes); e != list_end (&lock_classes);
+       e = list_next (e)) 
+    {
+      struct lock_class *c = list_entry (e, struct lock_class, elem);
+      const char *file = strrchr (c->file, '/');
+
+      if (c->acquire_cnt == 0)
+        continue;
+      printf ("  %s (%s:%d): %lld acquired, %lld contended, "
+              "wait %"PRIu64" total, %"PRIu64" max, hold %"PRIu64" max\n",
+              c->name, file != NULL ? file + 1 : c->file, c->line,
+              c->acquire_cnt, c->contended_cnt,
+              c->wait_total, c->wait_max, c->hold_max);
+    }
+}
+#endif /* LOCK_PROFILE */
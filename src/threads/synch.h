@@ -3,6 +3,7 @@
 
 #include <list.h>
 #include <stdbool.h>
+#include <stdint.h>
 
 /* A counting semaphore. */
 struct semaphore 
@@ -17,11 +18,40 @@ bool sema_try_down (struct semaphore *);
 void sema_up (struct semaphore *);
 void sema_self_test (void);
 
+#ifdef LOCK_PROFILE
+/* Contention statistics, shared by all the locks or rwlocks that
+   are initialized by the same lock_init() or rwlock_init() call
+   in the source, and named after it.  Times are in CPU cycles. */
+struct lock_class
+  {
+    const char *name;           /* Argument to lock_init(). */
+    const char *file;           /* Source file of lock_init() call. */
+    int line;                   /* Line of lock_init() call. */
+    bool registered;            /* In the list of all classes? */
+    struct list_elem elem;      /* Element in the list of all classes. */
+    long long acquire_cnt;      /* Number of acquisitions. */
+    long long contended_cnt;    /* Acquisitions that had to wait. */
+    uint64_t wait_total;        /* Total time spent waiting. */
+    uint64_t wait_max;          /* Longest wait. */
+    uint64_t hold_max;          /* Longest time held. */
+  };
+
+#define LOCK_CLASS_INITIALIZER(NAME) \
+        {.name = NAME, .file = __FILE__, .line = __LINE__}
+
+void lock_print_stats (void);
+#endif
+
 /* Lock. */
 struct lock 
   {
-    struct thread *holder;      /* Thread holding lock (for debugging). */
+    struct thread *holder;      /* Thread holding lock. */
     struct semaphore semaphore; /* Binary semaphore controlling access. */
+    struct list_elem elem;      /* Element in holder's held_locks list. */
+#ifdef LOCK_PROFILE
+    struct lock_class *class;   /* Statistics. */
+    uint64_t acquired;          /* Time of acquisition. */
+#endif
   };
 
 void lock_init (struct lock *);
@@ -38,14 +68,28 @@ struct condition
 
 void cond_init (struct condition *);
 void cond_wait (struct condition *, struct lock *);
+bool cond_wait_timeout (struct condition *, struct lock *, int64_t ticks);
 void cond_signal (struct condition *, struct lock *);
 void cond_broadcast (struct condition *, struct lock *);
 
+/* Readers-writer lock.  Phase-fair: a writer that arrives while
+   readers hold the lock keeps newer readers out and gets the lock
+   as soon as the current readers leave, and when a writer releases
+   the lock, all the readers that queued up meanwhile get it
+   together, ahead of any other waiting writer.  Thus neither
+   readers nor writers can starve.  Writers are served in FIFO
+   order. */
 struct rwlock
   {
-    struct lock mutex;
-    struct semaphore wrt;
-    int readcount;
+    int readers;                /* Number of threads holding read lock. */
+    struct thread *writer;      /* Thread holding write lock, if any. */
+    struct thread *upgrader;    /* Reader waiting in rwlock_upgrade(). */
+    struct list read_waiters;   /* Threads waiting to read. */
+    struct list write_waiters;  /* Threads waiting to write. */
+#ifdef LOCK_PROFILE
+    struct lock_class *class;   /* Statistics. */
+    uint64_t acquired;          /* Time it stopped being free. */
+#endif
   };
 
 void rwlock_init (struct rwlock *);
@@ -53,6 +97,36 @@ void rwlock_reader_lock (struct rwlock *);
 void rwlock_reader_unlock (struct rwlock *);
 void rwlock_writer_lock (struct rwlock *);
 void rwlock_writer_unlock (struct rwlock *);
+bool rwlock_upgrade (struct rwlock *);
+void rwlock_downgrade (struct rwlock *);
+
+#ifdef LOCK_PROFILE
+/* In a lock profiling kernel, every lock_init() and rwlock_init()
+   call site gets its own struct lock_class. */
+void lock_set_class (struct lock *, struct lock_class *);
+void rwlock_set_class (struct rwlock *, struct lock_class *);
+
+#define lock_init(LOCK)                                                 \
+        do                                                              \
+          {                                                             \
+            static struct lock_class lock_class_                        \
+              = LOCK_CLASS_INITIALIZER (#LOCK);                         \
+            struct lock *lock_ = (LOCK);                                \
+            (lock_init) (lock_);                                        \
+            lock_set_class (lock_, &lock_class_);                       \
+          }                                                             \
+        while (0)
+#define rwlock_init(RWLOCK)                                             \
+        do                                                              \
+          {                                                             \
+            static struct lock_class rwlock_class_                      \
+              = LOCK_CLASS_INITIALIZER (#RWLOCK);                       \
+            struct rwlock *rwlock_ = (RWLOCK);                          \
+            (rwlock_init) (rwlock_);                                    \
+            rwlock_set_class (rwlock_, &rwlock_class_);                 \
+          }                                                             \
+        while (0)
+#endif
 
 /* Optimization barrier.
 
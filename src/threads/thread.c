@@ -2,8 +2,11 @@
 #include <debug.h>
 #include <stddef.h>
 #include <random.h>
+#include <round.h>
 #include <stdio.h>
 #include <string.h>
+#include "devices/timer.h"
+#include "threads/fixed-point.h"
 #include "threads/flags.h"
 #include "threads/interrupt.h"
 #include "threads/intr-stubs.h"
@@ -20,9 +23,16 @@
    of thread.h for details. */
 #define THREAD_MAGIC 0xcd6abf4b
 
-/* List of processes in THREAD_READY state, that is, processes
-   that are ready to run but not actually running. */
-static struct list ready_list;
+/* Lists of processes in THREAD_READY state, that is, processes
+   that are ready to run but not actually running.  There is one
+   FIFO list per priority level.  Bit P of ready_mask is set
+   exactly when ready_lists[P] is nonempty, so the highest
+   priority ready thread can be found with a bit scan instead of
+   a walk over the lists. */
+#define PRI_CNT (PRI_MAX - PRI_MIN + 1)
+static struct list ready_lists[PRI_CNT];
+static uint32_t ready_mask[DIV_ROUND_UP (PRI_CNT, 32)];
+static int ready_cnt;           /* Number of threads in ready_lists. */
 
 /* Idle thread. */
 static struct thread *idle_thread;
@@ -46,6 +56,18 @@ static long long idle_ticks;    /* # of timer ticks spent idle. */
 static long long kernel_ticks;  /* # of timer ticks in kernel threads. */
 static long long user_ticks;    /* # of timer ticks in user programs. */
 
+/* Cache of pages freed by dying threads, reused by
+   thread_create() without going back to the page allocator.  A
+   recycled page need not be zeroed: init_thread() clears the
+   struct thread at its bottom and the rest is stack.  Accessed
+   only with interrupts off, because pages are put into the cache
+   by schedule_tail(), which runs with interrupts off. */
+#define THREAD_CACHE_SIZE 8
+static struct thread *thread_cache[THREAD_CACHE_SIZE];
+static int thread_cache_cnt;            /* Pages in thread_cache. */
+static long long thread_cache_hits;     /* # of pages reused. */
+static long long thread_cache_misses;   /* # of pages from palloc. */
+
 /* Scheduling. */
 #define TIME_SLICE 4            /* # of timer ticks to give each thread. */
 static unsigned thread_ticks;   /* # of timer ticks since last yield. */
@@ -55,14 +77,41 @@ static unsigned thread_ticks;   /* # of timer ticks since last yield. */
    Controlled by kernel command-line option "-o mlfqs". */
 bool thread_mlfqs;
 
+/* Multi-level feedback queue scheduler.
+
+   The running thread's recent_cpu is charged on every tick and
+   its priority recomputed every TIME_SLICE ticks, which is all
+   that can change between once-per-second updates.  Once per
+   second the load average is updated and every ready thread's
+   recent_cpu is decayed.  Blocked threads are not visited:
+   instead, each second's decay coefficient is recorded in
+   decay_history, and a thread that was blocked catches up on the
+   seconds it missed when it is unblocked.  Thus the per-tick
+   work is constant and the per-second work is proportional to
+   the number of ready threads, not to the number of threads. */
+#define DECAY_HISTORY 64                /* Seconds of coefficients kept. */
+static fixed_point load_avg;            /* System load average. */
+static unsigned mlfqs_epoch;            /* Seconds of decay applied. */
+static fixed_point decay_history[DECAY_HISTORY];
+
 static void kernel_thread (thread_func *, void *aux);
 
 static void idle (void *aux UNUSED);
 static struct thread *running_thread (void);
 static struct thread *next_thread_to_run (void);
+static void ready_push (struct thread *);
+static void ready_remove (struct thread *);
+static void set_effective_priority (struct thread *, int priority);
+static void mlfqs_tick (struct thread *);
+static void mlfqs_update_second (struct thread *);
+static void mlfqs_catch_up (struct thread *);
+static void mlfqs_update_priority (struct thread *);
+static int ready_max_priority (void);
 static void init_thread (struct thread *, const char *name, int priority);
 static bool is_thread (struct thread *) UNUSED;
 static void *alloc_frame (struct thread *, size_t size);
+static struct thread *alloc_thread_page (void);
+static void free_thread_page (struct thread *);
 static void schedule (void);
 void schedule_tail (struct thread *prev);
 static tid_t allocate_tid (void);
@@ -83,10 +132,13 @@ static tid_t allocate_tid (void);
 void
 thread_init (void) 
 {
+  int i;
+
   ASSERT (intr_get_level () == INTR_OFF);
 
   lock_init (&tid_lock);
-  list_init (&ready_list);
+  for (i = 0; i < PRI_CNT; i++)
+    list_init (&ready_lists[i]);
 
   /* Set up a thread structure for the running thread. */
   initial_thread = running_thread ();
@@ -129,6 +181,9 @@ thread_tick (void)
   else
     kernel_ticks++;
 
+  if (thread_mlfqs)
+    mlfqs_tick (t);
+
   /* Enforce preemption. */
   if (++thread_ticks >= TIME_SLICE)
     intr_yield_on_return ();
@@ -140,6 +195,8 @@ thread_print_stats (void)
 {
   printf ("Thread: %lld idle ticks, %lld kernel ticks, %lld user ticks\n",
           idle_ticks, kernel_ticks, user_ticks);
+  printf ("Thread: %lld page cache hits, %lld misses\n",
+          thread_cache_hits, thread_cache_misses);
 }
 
 /* Creates a new kernel thread named NAME with the given initial
@@ -154,9 +211,11 @@ thread_print_stats (void)
    scheduled.  Use a semaphore or some other form of
    synchronization if you need to ensure ordering.
 
-   The code provided sets the new thread's `priority' member to
-   PRIORITY, but no actual priority scheduling is implemented.
-   Priority scheduling is the goal of Problem 1-3. */
+   If the new thread has a higher priority than the running
+   thread, the running thread yields to it immediately.  Under
+   the multi-level feedback queue scheduler, PRIORITY is ignored
+   and the new thread inherits its creator's nice and recent_cpu
+   values instead. */
 tid_t
 thread_create (const char *name, int priority,
                thread_func *function, void *aux) 
@@ -170,13 +229,23 @@ thread_create (const char *name, int priority,
   ASSERT (function != NULL);
 
   /* Allocate thread. */
-  t = palloc_get_page (PAL_ZERO);
+  t = alloc_thread_page ();
   if (t == NULL)
     return TID_ERROR;
 
   /* Initialize thread. */
   init_thread (t, name, priority);
   tid = t->tid = allocate_tid ();
+  if (thread_mlfqs)
+    {
+      struct thread *cur = thread_current ();
+      enum intr_level old_level = intr_disable ();
+      t->nice = cur->nice;
+      t->recent_cpu = cur->recent_cpu;
+      t->cpu_epoch = cur->cpu_epoch;
+      mlfqs_update_priority (t);
+      intr_set_level (old_level);
+    }
 
   /* Stack frame for kernel_thread(). */
   kf = alloc_frame (t, sizeof *kf);
@@ -194,6 +263,7 @@ thread_create (const char *name, int priority,
 
   /* Add to run queue. */
   thread_unblock (t);
+  thread_preempt ();
 
   return tid;
 }
@@ -221,7 +291,8 @@ thread_block (void)
    This function does not preempt the running thread.  This can
    be important: if the caller had disabled interrupts itself,
    it may expect that it can atomically unblock a thread and
-   update other data. */
+   update other data.  Call thread_preempt() afterward to give
+   the CPU to T if it has a higher priority. */
 void
 thread_unblock (struct thread *t) 
 {
@@ -231,7 +302,12 @@ thread_unblock (struct thread *t)
 
   old_level = intr_disable ();
   ASSERT (t->status == THREAD_BLOCKED);
-  list_push_back (&ready_list, &t->elem);
+  if (thread_mlfqs)
+    {
+      mlfqs_catch_up (t);
+      mlfqs_update_priority (t);
+    }
+  ready_push (t);
   t->status = THREAD_READY;
   intr_set_level (old_level);
 }
@@ -300,17 +376,113 @@ thread_yield (void)
 
   old_level = intr_disable ();
   if (cur != idle_thread) 
-    list_push_back (&ready_list, &cur->elem);
+    ready_push (cur);
   cur->status = THREAD_READY;
   schedule ();
   intr_set_level (old_level);
 }
 
-/* Sets the current thread's priority to NEW_PRIORITY. */
+/* Yields the CPU if some ready thread has a higher priority than
+   the running thread.  Within an external interrupt handler the
+   yield is deferred until the interrupt returns. */
+void
+thread_preempt (void) 
+{
+  struct thread *cur = running_thread ();
+  enum intr_level old_level;
+  bool yield;
+
+  old_level = intr_disable ();
+  yield = (ready_max_priority () > cur->priority
+           || (cur == idle_thread && ready_max_priority () >= PRI_MIN));
+  intr_set_level (old_level);
+
+  if (!yield)
+    return;
+  if (intr_context ())
+    intr_yield_on_return ();
+  else
+    thread_yield ();
+}
+
+/* Sets the current thread's base priority to NEW_PRIORITY.  The
+   effective priority does not drop below any priority currently
+   donated to the thread.  Yields if the running thread no longer
+   has the highest priority.  Ignored under the multi-level
+   feedback queue scheduler, which sets priorities itself. */
 void
 thread_set_priority (int new_priority) 
 {
-  thread_current ()->priority = new_priority;
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+
+  ASSERT (PRI_MIN <= new_priority && new_priority <= PRI_MAX);
+
+  if (thread_mlfqs)
+    return;
+
+  old_level = intr_disable ();
+  cur->base_priority = new_priority;
+  thread_update_priority (cur);
+  intr_set_level (old_level);
+
+  thread_preempt ();
+}
+
+/* Raises T's effective priority to PRIORITY, if that is higher
+   than its current effective priority.  Used to donate priority
+   to the holder of a lock.  Interrupts must be off. */
+void
+thread_raise_priority (struct thread *t, int priority) 
+{
+  ASSERT (is_thread (t));
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (priority > t->priority)
+    set_effective_priority (t, priority);
+}
+
+/* Recomputes T's effective priority as the maximum of its base
+   priority and the priorities of the threads waiting for the
+   locks it holds.  Used when T releases a lock or changes its
+   base priority.  Interrupts must be off. */
+void
+thread_update_priority (struct thread *t) 
+{
+  struct list_elem *le, *we;
+  int priority;
+
+  ASSERT (is_thread (t));
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  priority = t->base_priority;
+  for (le = list_begin (&t->held_locks); le != list_end (&t->held_locks);
+       le = list_next (le))
+    {
+      struct lock *lock = list_entry (le, struct lock, elem);
+      struct list *waiters = &lock->semaphore.waiters;
+
+      for (we = list_begin (waiters); we != list_end (waiters);
+           we = list_next (we))
+        {
+          struct thread *w = list_entry (we, struct thread, elem);
+          if (w->priority > priority)
+            priority = w->priority;
+        }
+    }
+  set_effective_priority (t, priority);
+}
+
+/* Orders threads by effective priority, for use with list_max()
+   on lists linked through `elem'. */
+bool
+thread_priority_less (const struct list_elem *a_, const struct list_elem *b_,
+                      void *aux UNUSED) 
+{
+  const struct thread *a = list_entry (a_, struct thread, elem);
+  const struct thread *b = list_entry (b_, struct thread, elem);
+
+  return a->priority < b->priority;
 }
 
 /* Returns the current thread's priority. */
@@ -320,35 +492,160 @@ thread_get_priority (void)
   return thread_current ()->priority;
 }
 
-/* Sets the current thread's nice value to NICE. */
+/* Sets the current thread's nice value to NICE and recomputes
+   its priority.  Yields if the running thread no longer has the
+   highest priority. */
 void
-thread_set_nice (int nice UNUSED) 
+thread_set_nice (int nice) 
 {
-  /* Not yet implemented. */
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+
+  ASSERT (NICE_MIN <= nice && nice <= NICE_MAX);
+
+  old_level = intr_disable ();
+  cur->nice = nice;
+  if (thread_mlfqs)
+    mlfqs_update_priority (cur);
+  intr_set_level (old_level);
+
+  thread_preempt ();
 }
 
 /* Returns the current thread's nice value. */
 int
 thread_get_nice (void) 
 {
-  /* Not yet implemented. */
-  return 0;
+  return thread_current ()->nice;
 }
 
 /* Returns 100 times the system load average. */
 int
 thread_get_load_avg (void) 
 {
-  /* Not yet implemented. */
-  return 0;
+  enum intr_level old_level = intr_disable ();
+  int load_avg_100 = fp_round (load_avg * 100);
+  intr_set_level (old_level);
+
+  return load_avg_100;
 }
 
 /* Returns 100 times the current thread's recent_cpu value. */
 int
 thread_get_recent_cpu (void) 
 {
-  /* Not yet implemented. */
-  return 0;
+  enum intr_level old_level = intr_disable ();
+  int recent_cpu_100 = fp_round (thread_current ()->recent_cpu * 100);
+  intr_set_level (old_level);
+
+  return recent_cpu_100;
+}
+
+/* Multi-level feedback queue scheduler work for one timer tick,
+   with T the running thread.  Runs in an external interrupt
+   context. */
+static void
+mlfqs_tick (struct thread *t) 
+{
+  int64_t now = timer_ticks ();
+
+  if (t != idle_thread)
+    t->recent_cpu = fp_add_int (t->recent_cpu, 1);
+
+  if (now % TIMER_FREQ == 0)
+    mlfqs_update_second (t);
+
+  if (now % TIME_SLICE == 0 && t != idle_thread)
+    {
+      mlfqs_update_priority (t);
+      thread_preempt ();
+    }
+}
+
+/* Updates the load average and decays recent_cpu of the running
+   thread T and of every ready thread.  Called once per second.
+   Blocked threads catch up later, in mlfqs_catch_up(). */
+static void
+mlfqs_update_second (struct thread *t) 
+{
+  int ready_threads = ready_cnt + (t != idle_thread ? 1 : 0);
+  fixed_point twice_load;
+  int pri;
+
+  load_avg = (59 * load_avg + fp_from_int (ready_threads)) / 60;
+  twice_load = 2 * load_avg;
+  mlfqs_epoch++;
+  decay_history[mlfqs_epoch % DECAY_HISTORY]
+    = fp_div (twice_load, fp_add_int (twice_load, 1));
+
+  if (t != idle_thread)
+    mlfqs_catch_up (t);
+
+  /* A thread whose priority changes moves to another list and
+     may be visited again, which is harmless because it has
+     already caught up. */
+  for (pri = PRI_MIN; pri <= PRI_MAX; pri++) 
+    {
+      struct list *list = &ready_lists[pri - PRI_MIN];
+      struct list_elem *e, *next;
+
+      for (e = list_begin (list); e != list_end (list); e = next) 
+        {
+          struct thread *r = list_entry (e, struct thread, elem);
+          next = list_next (e);
+          if (r != idle_thread)
+            {
+              mlfqs_catch_up (r);
+              mlfqs_update_priority (r);
+            }
+        }
+    }
+}
+
+/* Applies to T's recent_cpu the once-per-second decays that it
+   has missed, using the coefficients in decay_history.  A thread
+   blocked for longer than DECAY_HISTORY seconds is decayed by the
+   oldest recorded coefficient for the seconds that are no longer
+   on record, stopping early once its recent_cpu stops changing. */
+static void
+mlfqs_catch_up (struct thread *t) 
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  while (t->cpu_epoch != mlfqs_epoch) 
+    {
+      unsigned missed = mlfqs_epoch - t->cpu_epoch;
+      fixed_point coeff, recent_cpu;
+
+      if (missed > DECAY_HISTORY)
+        coeff = decay_history[(mlfqs_epoch + 1) % DECAY_HISTORY];
+      else
+        coeff = decay_history[(t->cpu_epoch + 1) % DECAY_HISTORY];
+
+      recent_cpu = fp_add_int (fp_mul (coeff, t->recent_cpu), t->nice);
+      if (missed > DECAY_HISTORY && recent_cpu == t->recent_cpu)
+        t->cpu_epoch = mlfqs_epoch - DECAY_HISTORY;
+      else
+        t->cpu_epoch++;
+      t->recent_cpu = recent_cpu;
+    }
+}
+
+/* Recomputes T's priority from its recent_cpu and nice values. */
+static void
+mlfqs_update_priority (struct thread *t) 
+{
+  int priority = fp_trunc (fp_from_int (PRI_MAX - t->nice * 2)
+                           - t->recent_cpu / 4);
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (priority < PRI_MIN)
+    priority = PRI_MIN;
+  else if (priority > PRI_MAX)
+    priority = PRI_MAX;
+  t->base_priority = priority;
+  set_effective_priority (t, priority);
 }
 
 /* Idle thread.  Executes when no other thread is ready to run.
@@ -373,6 +670,17 @@ idle (void *idle_started_ UNUSED)
       intr_disable ();
       thread_block ();
 
+      /* Nothing else is ready, so stock up on zeroed pages.  An
+         interrupt that readies another thread preempts us. */
+      intr_enable ();
+      while (palloc_zero_idle ())
+        continue;
+      intr_disable ();
+
+      /* Nothing else can run until an interrupt arrives, so don't
+         take timer interrupts that would have nothing to do. */
+      timer_tickless_enter ();
+
       /* Re-enable interrupts and wait for the next one.
 
          The `sti' instruction disables interrupts until the
@@ -434,7 +742,11 @@ init_thread (struct thread *t, const char *name, int priority)
   t->status = THREAD_BLOCKED;
   strlcpy (t->name, name, sizeof t->name);
   t->stack = (uint8_t *) t + PGSIZE;
-  t->priority = priority;
+  t->priority = t->base_priority = priority;
+  list_init (&t->held_locks);
+#ifdef VM
+  list_init (&t->mappings);
+#endif
   t->magic = THREAD_MAGIC;
 }
 
@@ -451,18 +763,129 @@ alloc_frame (struct thread *t, size_t size)
   return t->stack;
 }
 
+/* Adds T to the back of the run queue for its priority. */
+static void
+ready_push (struct thread *t) 
+{
+  int pri = t->priority;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (PRI_MIN <= pri && pri <= PRI_MAX);
+
+  list_push_back (&ready_lists[pri - PRI_MIN], &t->elem);
+  ready_cnt++;
+  ready_mask[(pri - PRI_MIN) / 32] |= 1u << ((pri - PRI_MIN) % 32);
+}
+
+/* Removes ready thread T from the run queue. */
+static void
+ready_remove (struct thread *t) 
+{
+  int pri = t->priority;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (t->status == THREAD_READY);
+
+  list_remove (&t->elem);
+  ready_cnt--;
+  if (list_empty (&ready_lists[pri - PRI_MIN]))
+    ready_mask[(pri - PRI_MIN) / 32] &= ~(1u << ((pri - PRI_MIN) % 32));
+}
+
+/* Sets T's effective priority to PRIORITY, moving T to the
+   matching run queue if it is ready. */
+static void
+set_effective_priority (struct thread *t, int priority) 
+{
+  ASSERT (PRI_MIN <= priority && priority <= PRI_MAX);
+
+  if (t->priority == priority)
+    return;
+  if (t->status == THREAD_READY)
+    {
+      ready_remove (t);
+      t->priority = priority;
+      ready_push (t);
+    }
+  else
+    t->priority = priority;
+}
+
+/* Returns the priority of the highest priority ready thread, or
+   PRI_MIN - 1 if the run queue is empty. */
+static int
+ready_max_priority (void) 
+{
+  int word;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  for (word = sizeof ready_mask / sizeof *ready_mask - 1; word >= 0; word--)
+    if (ready_mask[word] != 0)
+      return PRI_MIN + word * 32 + (31 - __builtin_clz (ready_mask[word]));
+  return PRI_MIN - 1;
+}
+
 /* Chooses and returns the next thread to be scheduled.  Should
    return a thread from the run queue, unless the run queue is
    empty.  (If the running thread can continue running, then it
    will be in the run queue.)  If the run queue is empty, return
-   idle_thread. */
+   idle_thread.
+
+   Picks the front of the highest nonempty priority list, so
+   threads of equal priority run round-robin. */
 static struct thread *
 next_thread_to_run (void) 
 {
-  if (list_empty (&ready_list))
+  int pri = ready_max_priority ();
+  struct thread *t;
+
+  if (pri < PRI_MIN)
     return idle_thread;
+
+  t = list_entry (list_front (&ready_lists[pri - PRI_MIN]),
+                  struct thread, elem);
+  ready_remove (t);
+  return t;
+}
+
+/* Returns a page for a new thread, from thread_cache if
+   possible, otherwise from the page allocator.  Only the struct
+   thread at the bottom of the page will be initialized, so the
+   page is not requested with PAL_ZERO and never takes one of the
+   allocator's pre-zeroed pages. */
+static struct thread *
+alloc_thread_page (void) 
+{
+  struct thread *t = NULL;
+  enum intr_level old_level;
+
+  old_level = intr_disable ();
+  if (thread_cache_cnt > 0) 
+    {
+      t = thread_cache[--thread_cache_cnt];
+      thread_cache_hits++;
+    }
+  else
+    thread_cache_misses++;
+  intr_set_level (old_level);
+
+  if (t == NULL)
+    t = palloc_get_page (0);
+  return t;
+}
+
+/* Frees the page of dead thread T, keeping it in thread_cache if
+   there is room. */
+static void
+free_thread_page (struct thread *t) 
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (thread_cache_cnt < THREAD_CACHE_SIZE)
+    thread_cache[thread_cache_cnt++] = t;
   else
-    return list_entry (list_pop_front (&ready_list), struct thread, elem);
+    palloc_free_page (t);
 }
 
 /* Completes a thread switch by activating the new thread's page
@@ -507,7 +930,7 @@ schedule_tail (struct thread *prev)
   if (prev != NULL && prev->status == THREAD_DYING && prev != initial_thread) 
     {
       ASSERT (prev != cur);
-      palloc_free_page (prev);
+      free_thread_page (prev);
     }
 }
 
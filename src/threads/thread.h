@@ -32,6 +32,11 @@ typedef int tid_t;
 #define PRI_DEFAULT 31                  /* Default priority. */
 #define PRI_MAX 63                      /* Highest priority. */
 
+/* Thread niceness, for the multi-level feedback queue scheduler. */
+#define NICE_MIN -20                    /* Nicest to other threads. */
+#define NICE_DEFAULT 0                  /* Default niceness. */
+#define NICE_MAX 20                     /* Least nice. */
+
 /* A kernel thread or user process.
 
    Each thread structure is stored in its own 4 kB page.  The
@@ -95,7 +100,15 @@ struct thread
     enum thread_status status;          /* Thread state. */
     char name[16];                      /* Name (for debugging purposes). */
     uint8_t *stack;                     /* Saved stack pointer. */
-    int priority;                       /* Priority. */
+    int priority;                       /* Effective priority. */
+    int base_priority;                  /* Priority without donations. */
+    struct list held_locks;             /* Locks held, for donation. */
+    struct lock *waiting_lock;          /* Lock being waited for, if any. */
+
+    /* Used only by the multi-level feedback queue scheduler. */
+    int nice;                           /* Niceness. */
+    int recent_cpu;                     /* Recent CPU time, fixed point. */
+    unsigned cpu_epoch;                 /* Last second applied to recent_cpu. */
 
     /* Shared between thread.c and synch.c. */
     struct list_elem elem;              /* List element. */
@@ -111,6 +124,26 @@ struct thread
     bool           hash_initialized;
     struct hash    children_hash;
 #endif
+#ifdef VM
+    /* Owned by vm/page.c. */
+    struct hash *pages;                 /* Supplemental page table. */
+    long long major_faults;             /* Page-ins that read the disk. */
+    long long minor_faults;             /* Page-ins without disk reads. */
+    long long prefetch_hits;            /* Prefetched pages mapped. */
+    void *fault_last;                   /* Last shared page faulted in. */
+    void *prefetch_end;                 /* End of pages read ahead. */
+
+    /* Set on entry to the kernel from user mode, by
+       userprog/exception.c and userprog/syscall.c. */
+    void *user_esp;                     /* User stack pointer. */
+
+    /* Owned by vm/mmap.c. */
+    struct list mappings;               /* Memory-mapped files. */
+    int next_mapid;                     /* Next map region identifier. */
+
+    /* Owned by userprog/process.c. */
+    struct file *exec_file;             /* Executable, read on demand. */
+#endif
 
     /* Owned by thread.c. */
     unsigned magic;                     /* Detects stack overflow. */
@@ -139,9 +172,14 @@ const char *thread_name (void);
 
 void thread_exit (int exit_code) NO_RETURN;
 void thread_yield (void);
+void thread_preempt (void);
 
 int thread_get_priority (void);
 void thread_set_priority (int);
+void thread_raise_priority (struct thread *, int priority);
+void thread_update_priority (struct thread *);
+bool thread_priority_less (const struct list_elem *,
+                           const struct list_elem *, void *aux);
 
 int thread_get_nice (void);
 void thread_set_nice (int);
@@ -0,0 +1,17 @@
+#ifndef THREADS_TSC_H
+#define THREADS_TSC_H
+
+#include <stdint.h>
+
+/* Reads the CPU's time-stamp counter, which counts CPU cycles.
+   Useful for measuring intervals much shorter than a timer
+   tick.  See [IA32-v2b] "RDTSC". */
+static inline uint64_t
+read_tsc (void) 
+{
+  uint64_t tsc;
+  asm volatile ("rdtsc" : "=A" (tsc));
+  return tsc;
+}
+
+#endif /* threads/tsc.h */
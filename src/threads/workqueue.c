@@ -0,0 +1,171 @@
+#include "threads/workqueue.h"
+#include <debug.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/interrupt.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/tsc.h"
+
+/* A queue of work items and the thread that runs them. */
+struct workqueue
+  {
+    struct list_elem elem;      /* Element in all_queues. */
+    char name[16];              /* Name, also of the worker thread. */
+    struct list works;          /* Queued work items. */
+    struct semaphore ready;     /* Number of queued work items. */
+
+    /* Statistics.  Changed only with interrupts off. */
+    int depth;                  /* Current number of queued items. */
+    int max_depth;              /* Largest DEPTH so far. */
+    long long run_cnt;          /* Number of work items run. */
+    uint64_t total_latency;     /* Sum of queue-to-run cycles. */
+    uint64_t max_latency;       /* Longest queue-to-run cycles. */
+  };
+
+/* List of all workqueues, for statistics.
+   Changed only with interrupts off. */
+static struct list all_queues;
+
+static thread_func worker;
+
+/* Initializes the workqueue system. */
+void
+workqueue_init (void) 
+{
+  list_init (&all_queues);
+}
+
+/* Creates and returns a new workqueue named NAME, whose work items
+   are run by a new kernel thread at the given PRIORITY.  Returns
+   a null pointer if memory or the thread cannot be allocated.
+
+   Workqueues cannot be destroyed, which is fine because they are
+   meant to be created once, when a subsystem is initialized. */
+struct workqueue *
+workqueue_create (const char *name, int priority) 
+{
+  struct workqueue *wq;
+  enum intr_level old_level;
+
+  ASSERT (name != NULL);
+  ASSERT (PRI_MIN <= priority && priority <= PRI_MAX);
+
+  wq = malloc (sizeof *wq);
+  if (wq == NULL)
+    return NULL;
+
+  strlcpy (wq->name, name, sizeof wq->name);
+  list_init (&wq->works);
+  sema_init (&wq->ready, 0);
+  wq->depth = wq->max_depth = 0;
+  wq->run_cnt = 0;
+  wq->total_latency = wq->max_latency = 0;
+
+  if (thread_create (wq->name, priority, worker, wq) == TID_ERROR) 
+    {
+      free (wq);
+      return NULL;
+    }
+
+  old_level = intr_disable ();
+  list_push_back (&all_queues, &wq->elem);
+  intr_set_level (old_level);
+
+  return wq;
+}
+
+/* Initializes WORK to call FUNC, passing AUX, when it is run. */
+void
+work_init (struct work *work, work_func *func, void *aux) 
+{
+  ASSERT (work != NULL);
+  ASSERT (func != NULL);
+
+  work->func = func;
+  work->aux = aux;
+  work->pending = false;
+}
+
+/* Queues WORK to be run by WQ's worker thread.  Returns true if
+   successful, false if WORK was already queued and has not yet
+   started running, in which case it will still run only once.
+   A work item may queue itself again from its own function.
+
+   This function may be called from an interrupt handler. */
+bool
+work_queue (struct workqueue *wq, struct work *work) 
+{
+  enum intr_level old_level;
+
+  ASSERT (wq != NULL);
+  ASSERT (work != NULL);
+
+  old_level = intr_disable ();
+  if (work->pending) 
+    {
+      intr_set_level (old_level);
+      return false;
+    }
+  work->pending = true;
+  work->queued = read_tsc ();
+  list_push_back (&wq->works, &work->elem);
+  if (++wq->depth > wq->max_depth)
+    wq->max_depth = wq->depth;
+  intr_set_level (old_level);
+
+  sema_up (&wq->ready);
+  return true;
+}
+
+/* Prints statistics for every workqueue. */
+void
+workqueue_print_stats (void) 
+{
+  struct list_elem *e;
+
+  for (e = list_begin (&all_queues); e != list_end (&all_queues);
+       e = list_next (e)) 
+    {
+      struct workqueue *wq = list_entry (e, struct workqueue, elem);
+      uint64_t avg = wq->run_cnt > 0 ? wq->total_latency / wq->run_cnt : 0;
+
+      printf ("Workqueue %s: %lld items run, max depth %d, "
+              "latency %"PRIu64" avg, %"PRIu64" max cycles\n",
+              wq->name, wq->run_cnt, wq->max_depth,
+              avg, wq->max_latency);
+    }
+}
+
+/* Worker thread for workqueue WQ_: runs queued work items, one
+   at a time, forever. */
+static void
+worker (void *wq_) 
+{
+  struct workqueue *wq = wq_;
+
+  for (;;) 
+    {
+      struct work *work;
+      enum intr_level old_level;
+      uint64_t latency;
+
+      sema_down (&wq->ready);
+
+      old_level = intr_disable ();
+      ASSERT (!list_empty (&wq->works));
+      work = list_entry (list_pop_front (&wq->works), struct work, elem);
+      work->pending = false;
+      wq->depth--;
+      wq->run_cnt++;
+      latency = read_tsc () - work->queued;
+      wq->total_latency += latency;
+      if (latency > wq->max_latency)
+        wq->max_latency = latency;
+      intr_set_level (old_level);
+
+      work->func (work->aux);
+    }
+}
@@ -0,0 +1,40 @@
+#ifndef THREADS_WORKQUEUE_H
+#define THREADS_WORKQUEUE_H
+
+#include <list.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Deferred work.
+
+   An external interrupt handler runs with interrupts off and
+   cannot sleep, so it should do as little as possible and return.
+   Work that can wait a little is better wrapped in a struct work
+   and handed to a workqueue with work_queue(), which may be
+   called from an interrupt handler.  Each workqueue has its own
+   kernel thread that runs the queued work in FIFO order, in
+   thread context, at the priority given to workqueue_create(). */
+
+/* Function run by a work item. */
+typedef void work_func (void *aux);
+
+/* A work item.  Usually embedded in the structure it works on. */
+struct work
+  {
+    struct list_elem elem;      /* Element in workqueue. */
+    work_func *func;            /* Function to run. */
+    void *aux;                  /* Argument to FUNC. */
+    bool pending;               /* Queued and not yet started? */
+    uint64_t queued;            /* Time queued, in CPU cycles. */
+  };
+
+struct workqueue;
+
+void workqueue_init (void);
+struct workqueue *workqueue_create (const char *name, int priority);
+void workqueue_print_stats (void);
+
+void work_init (struct work *, work_func *, void *aux);
+bool work_queue (struct workqueue *, struct work *);
+
+#endif /* threads/workqueue.h */
@@ -4,6 +4,10 @@
 #include "userprog/gdt.h"
 #include "threads/interrupt.h"
 #include "threads/thread.h"
+#include "threads/vaddr.h"
+#ifdef VM
+#include "vm/page.h"
+#endif
 
 /* Number of page faults processed. */
 static long long page_fault_cnt;
@@ -148,9 +152,33 @@ page_fault (struct intr_frame *f)
   write = (f->error_code & PF_W) != 0;
   user = (f->error_code & PF_U) != 0;
 
-  /* To implement virtual memory, delete the rest of the function
-     body, and replace it with code that brings in the page to
-     which fault_addr refers. */
+#ifdef VM
+  /* Remember the user stack pointer for growing the stack.  In
+     kernel context, it was saved when the system call began. */
+  if (user)
+    thread_current ()->user_esp = f->esp;
+
+  /* A page that is not present may just not have been touched
+     yet, and a write to a page that is mapped read-only may be
+     the first write to a page mapped to the zero page.  This
+     applies to the kernel too, when it accesses user memory on
+     behalf of a system call.  It may also be an access to the
+     stack just below the stack pointer, which grows the stack. */
+  if (is_user_vaddr (fault_addr) && page_in (fault_addr, write))
+    return;
+#endif
+
+  /* The kernel only touches unchecked user memory through
+     get_user() in syscall.c, which leaves the address to resume
+     at in EAX.  Make it return -1 from there, so the system call
+     can fail without this handler unwinding past any locks. */
+  if (!user && is_user_vaddr (fault_addr))
+    {
+      f->eip = (void (*) (void)) f->eax;
+      f->eax = 0xffffffff;
+      return;
+    }
+
   printf ("Page fault at %p: %s error %s page in %s context.\n",
           fault_addr,
           not_present ? "not present" : "rights violation",
@@ -2,6 +2,7 @@
 #include <stdbool.h>
 #include <stddef.h>
 #include <string.h>
+#include "threads/cpu.h"
 #include "threads/init.h"
 #include "threads/pte.h"
 #include "threads/palloc.h"
@@ -136,6 +137,19 @@ pagedir_get_page (uint32_t *pd, const void *uaddr)
     return NULL;
 }
 
+/* Returns true if user virtual address UADDR is mapped in PD
+   and its page is writable, false otherwise. */
+bool
+pagedir_is_writable (uint32_t *pd, const void *uaddr)
+{
+  uint32_t *pte;
+
+  ASSERT (is_user_vaddr (uaddr));
+
+  pte = lookup_page (pd, uaddr, false);
+  return pte != NULL && (*pte & PTE_P) != 0 && (*pte & PTE_W) != 0;
+}
+
 /* Marks user virtual page UPAGE "not present" in page
    directory PD.  Later accesses to the page will fault.  Other
    bits in the page table entry are preserved.
@@ -224,23 +238,24 @@ pagedir_activate (uint32_t *pd)
 
   /* Store the physical address of the page directory into CR3
      aka PDBR (page directory base register).  This activates our
-     new page tables immediately.  See [IA32-v2a] "MOV--Move
-     to/from Control Registers" and [IA32-v3a] 3.7.5 "Base
-     Address of the Page Directory". */
-  asm volatile ("movl %0, %%cr3" : : "r" (vtop (pd)) : "memory");
+     new page tables immediately.  See [IA32-v3a] 3.7.5 "Base
+     Address of the Page Directory".
+
+     Writing CR3 also flushes the TLB, so don't do it if PD is
+     already active, e.g. when switching between kernel threads
+     or between threads that share a page directory. */
+  if (pd != active_pd ())
+    cr3_write (vtop (pd));
 }
 
 /* Returns the currently active page directory. */
 static uint32_t *
 active_pd (void) 
 {
-  /* Copy CR3, the page directory base register (PDBR), into
-     `pd'.
-     See [IA32-v2a] "MOV--Move to/from Control Registers" and
-     [IA32-v3a] 3.7.5 "Base Address of the Page Directory". */
-  uintptr_t pd;
-  asm volatile ("movl %%cr3, %0" : "=r" (pd));
-  return ptov (pd);
+  /* CR3, the page directory base register (PDBR), holds its
+     physical address.  See [IA32-v3a] 3.7.5 "Base Address of the
+     Page Directory". */
+  return ptov (cr3_read ());
 }
 
 /* Seom page table changes can cause the CPU's translation
@@ -256,8 +271,9 @@ invalidate_pagedir (uint32_t *pd)
 {
   if (active_pd () == pd) 
     {
-      /* Re-activating PD clears the TLB.  See [IA32-v3a] 3.12
-         "Translation Lookaside Buffers (TLBs)". */
-      pagedir_activate (pd);
+      /* Reloading CR3 clears the TLB, except for the kernel's
+         global mappings, which never change.  See [IA32-v3a]
+         3.12 "Translation Lookaside Buffers (TLBs)". */
+      cr3_write (vtop (pd));
     } 
 }
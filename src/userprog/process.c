@@ -19,7 +19,12 @@
 #include "threads/vaddr.h"
 #include "threads/synch.h"
 #include "threads/malloc.h"
+#include "threads/slab.h"
 #include "lib/kernel/hash.h"
+#ifdef VM
+#include "vm/mmap.h"
+#include "vm/page.h"
+#endif
 
 static thread_func start_process NO_RETURN;
 static bool load (const char *file_name, const char **args, int argc, void (**eip) (void), void **esp);
@@ -45,10 +50,27 @@ struct child_status
   int ref_cnt;
 };
 
+/* Cache of struct child_status. */
+static struct kmem_cache *child_status_cache;
+
+/* Initializes the process module. */
+void
+process_init (void)
+{
+  child_status_cache = kmem_cache_create ("child_status",
+                                          sizeof (struct child_status),
+                                          NULL);
+  if (child_status_cache == NULL)
+    PANIC ("can't create child_status cache");
+}
+
 static struct child_status *
 child_status_new (tid_t tid)
 {
-  struct child_status *cs = malloc (sizeof (struct child_status));
+  struct child_status *cs = kmem_cache_alloc (child_status_cache);
+
+  if (cs == NULL)
+    return NULL;
 
   cs->tid = tid;
   sema_init (&cs->sema, 0);
@@ -73,7 +95,7 @@ child_status_unref (struct child_status *cs)
   lock_release (&cs->ref_cnt_lock);
 
   if (free_cs)
-    free (cs);
+    kmem_cache_free (child_status_cache, cs);
 }
 
 unsigned
@@ -238,9 +260,22 @@ process_exit (int exit_code)
          that's been freed (and cleared). */
       cur->pagedir = NULL;
       pagedir_activate (NULL);
+#ifdef VM
+      /* The supplemental page table frees the process's frames
+         itself, so it must go first.  Unmapping files writes
+         back their modified pages. */
+      mmap_unmap_all ();
+      page_table_destroy (cur->pages);
+      cur->pages = NULL;
+#endif
       pagedir_destroy (pd);
     }
 
+#ifdef VM
+  file_close (cur->exec_file);
+  cur->exec_file = NULL;
+#endif
+
   if (cur->files_bitmap != NULL)
     {
       unsigned id = 0;
@@ -256,6 +291,9 @@ process_exit (int exit_code)
     {
       cs->exit_code = exit_code;
       printf("%s: exit(%d)\n", cur->name, cs->exit_code);
+#ifdef VM
+      page_print_process_stats ();
+#endif
 
       sema_up (&cs->sema);
       child_status_unref (cs);
@@ -371,6 +409,13 @@ load (const char *file_name, const char **args, int argc, void (**eip) (void), v
     goto done;
   process_activate ();
 
+#ifdef VM
+  /* Allocate supplemental page table. */
+  t->pages = page_table_create ();
+  if (t->pages == NULL)
+    goto done;
+#endif
+
   /* Initialize file bitmap */
   t->files_bitmap = bitmap_create (MAX_FILES);
   if (t->files_bitmap == NULL)
@@ -520,13 +565,25 @@ load (const char *file_name, const char **args, int argc, void (**eip) (void), v
 
  done:
   /* We arrive here whether the load is successful or not. */
+#ifdef VM
+  /* Keep the executable open, and unmodified, so that its pages
+     can be read when they are first touched. */
+  if (success) 
+    {
+      file_deny_write (file);
+      t->exec_file = file;
+      return true;
+    }
+#endif
   file_close (file);
   return success;
 }
 
 /* load() helpers. */
 
+#ifndef VM
 static bool install_page (void *upage, void *kpage, bool writable);
+#endif
 
 /* Checks whether PHDR describes a valid, loadable segment in
    FILE and returns true if so, false otherwise. */
@@ -585,6 +642,11 @@ validate_segment (const struct Elf32_Phdr *phdr, struct file *file)
    The pages initialized by this function must be writable by the
    user process if WRITABLE is true, read-only otherwise.
 
+   With virtual memory, the pages are only entered into the
+   supplemental page table here, and read or zeroed when they are
+   first touched; read-only pages are shared with other processes
+   running the same executable.  FILE must then remain open.
+
    Return true if successful, false if a memory allocation error
    or disk read error occurs. */
 static bool
@@ -595,7 +657,9 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
   ASSERT (pg_ofs (upage) == 0);
   ASSERT (ofs % PGSIZE == 0);
 
+#ifndef VM
   file_seek (file, ofs);
+#endif
   while (read_bytes > 0 || zero_bytes > 0) 
     {
       /* Calculate how to fill this page.
@@ -604,6 +668,14 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
       size_t page_read_bytes = read_bytes < PGSIZE ? read_bytes : PGSIZE;
       size_t page_zero_bytes = PGSIZE - page_read_bytes;
 
+#ifdef VM
+      /* Record how to fill the page when it is touched. */
+      if (page_read_bytes > 0
+          ? !page_add_file (upage, file, ofs, page_read_bytes, writable)
+          : !page_add_zero (upage, writable))
+        return false;
+      ofs += page_read_bytes;
+#else
       /* Get a page of memory. */
       uint8_t *kpage = palloc_get_page (PAL_USER);
       if (kpage == NULL)
@@ -623,6 +695,7 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
           palloc_free_page (kpage);
           return false; 
         }
+#endif
 
       /* Advance. */
       read_bytes -= page_read_bytes;
@@ -637,6 +710,14 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
 static bool
 setup_stack (void **esp) 
 {
+#ifdef VM
+  /* The stack page is written right away, so bring it in now. */
+  uint8_t *upage = ((uint8_t *) PHYS_BASE) - PGSIZE;
+  if (!page_add_zero (upage, true) || !page_in (upage, true))
+    return false;
+  *esp = PHYS_BASE;
+  return true;
+#else
   uint8_t *kpage;
   bool success = false;
 
@@ -650,6 +731,7 @@ setup_stack (void **esp)
         palloc_free_page (kpage);
     }
   return success;
+#endif
 }
 
 static void
@@ -696,6 +778,7 @@ init_stack (void **esp, const char **args, int argc)
   *esp = pesp;
 }
 
+#ifndef VM
 /* Adds a mapping from user virtual address UPAGE to kernel
    virtual address KPAGE to the page table.
    If WRITABLE is true, the user process may modify the page;
@@ -715,3 +798,4 @@ install_page (void *upage, void *kpage, bool writable)
   return (pagedir_get_page (t->pagedir, upage) == NULL
           && pagedir_set_page (t->pagedir, upage, kpage, writable));
 }
+#endif
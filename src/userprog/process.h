@@ -3,6 +3,7 @@
 
 #include "threads/thread.h"
 
+void process_init (void);
 tid_t process_execute (const char *file_name);
 int process_wait (tid_t);
 void process_exit (int exit_code);
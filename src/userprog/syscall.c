@@ -12,19 +12,125 @@
 #include "filesys/file.h"
 #include "lib/kernel/bitmap.h"
 #include "devices/input.h"
+#ifdef VM
+#include "vm/frame.h"
+#include "vm/mmap.h"
+#include "vm/page.h"
+#endif
 
 
 static void syscall_handler (struct intr_frame *);
+static void unpin_user_buffer (const void *buf, unsigned size);
 
 #define FILE_ID_OFFSET 2
 
 /*
- * Macro to check if a pointer lies user space.
+ * Returns true if P is a mapped user address, and writable if
+ * WRITE is true, bringing its page into memory first if it has
+ * not been touched yet.
+ */
+static bool
+is_user_mapped (const void *p, bool write)
+{
+  if ((uint32_t)p >= (uint32_t)PHYS_BASE)
+    return false;
+#ifdef VM
+  return page_in ((void *)p, write);
+#else
+  if (write)
+    return pagedir_is_writable (thread_current ()->pagedir, p);
+  return pagedir_get_page (thread_current ()->pagedir, p) != NULL;
+#endif
+}
+
+/*
+ * Reads a byte at user virtual address UADDR, which must be
+ * below PHYS_BASE.  Returns the byte value if successful, -1 if
+ * a page fault occurred.  page_fault() recovers from the fault
+ * by resuming at the address this leaves in EAX.
+ */
+static int
+get_user (const uint8_t *uaddr)
+{
+  int result;
+  asm ("movl $1f, %0; movzbl %1, %0; 1:"
+       : "=&a" (result) : "m" (*uaddr));
+  return result;
+}
+
+/*
+ * Returns true if all SIZE bytes at BUF are mapped user
+ * addresses, and writable if WRITE is true, bringing every page
+ * of the buffer into memory and pinning it there until
+ * unpin_user_buffer() is called, so that the file system never
+ * faults on it while it holds a disk or inode lock.  Pins
+ * nothing if it returns false.
+ */
+static bool
+pin_user_buffer (const void *buf, unsigned size, bool write)
+{
+  const uint8_t *p;
+  const uint8_t *end = (const uint8_t *)buf + size;
+
+  if (size == 0)
+    return true;
+  if ((uint32_t)end < (uint32_t)buf || (uint32_t)end > (uint32_t)PHYS_BASE)
+    return false;
+
+  for (p = pg_round_down (buf); p < end; p += PGSIZE)
+    {
+#ifdef VM
+      if (!page_pin ((void *)p, write))
+        {
+          unpin_user_buffer (buf, p - (const uint8_t *)buf);
+          return false;
+        }
+#else
+      if (!is_user_mapped (p, write))
+        return false;
+#endif
+    }
+  return true;
+}
+
+/*
+ * Unpins the SIZE bytes at BUF, pinned by pin_user_buffer().
+ */
+static void
+unpin_user_buffer (const void *buf UNUSED, unsigned size UNUSED)
+{
+#ifdef VM
+  const uint8_t *p;
+  const uint8_t *end = (const uint8_t *)buf + size;
+
+  for (p = pg_round_down (buf); p < end; p += PGSIZE)
+    page_unpin ((void *)p);
+#endif
+}
+
+/*
+ * Macro to check if the object P points to lies in user space.
  * Exits the thread and returns otherwise.
  */
 #define CHECK_POINTER(P)                                        \
   do {                                                          \
-    if ((uint32_t)(P) >= (uint32_t)PHYS_BASE || !pagedir_get_page (thread_current ()->pagedir, (P))) \
+    if (!is_user_mapped (P, false)                              \
+        || !is_user_mapped ((const char *)(P) + sizeof *(P) - 1, \
+                            false))                             \
+    {                                                           \
+      thread_exit (-1);                                         \
+      return;                                                   \
+    }                                                           \
+  } while (0)
+
+/*
+ * Macro to check if a buffer of SIZE bytes lies in user space,
+ * and is writable if WRITE is true, and pin it in memory.
+ * Exits the thread and returns otherwise.
+ */
+#define CHECK_BUFFER(B, SIZE, WRITE)                            \
+  do {                                                          \
+    if (!pin_user_buffer (B, SIZE, WRITE))                      \
     {                                                           \
       thread_exit (-1);                                         \
       return;                                                   \
@@ -34,15 +140,20 @@ static void syscall_handler (struct intr_frame *);
 static bool
 check_string (char *str)
 {
+  int c;
+
   if (str == NULL)
     return false;
 
-  while (*str != '\0')
+  do
   {
-    str++;
     if ((uint32_t)str >= (uint32_t)PHYS_BASE)
       return false;
+    c = get_user ((const uint8_t *)str++);
+    if (c == -1)
+      return false;
   }
+  while (c != '\0');
 
   return true;
 }
@@ -144,9 +255,8 @@ syscall_read (struct intr_frame *f)
   buf = (void *)*esp++;
   size = (unsigned)*esp;
 
-  /* Check so that buf lies in userspace */
-  CHECK_POINTER (buf);
-  CHECK_POINTER (buf + size - 1);
+  /* Check so that buf lies in userspace and can be written */
+  CHECK_BUFFER (buf, size, true);
 
   if (fd == STDIN_FILENO)
     {
@@ -164,15 +274,14 @@ syscall_read (struct intr_frame *f)
       int id = fd - FILE_ID_OFFSET;
 
       if (!bitmap_test (cur->files_bitmap, id))
-	{
-	  f->eax = -1;
-	  return;
-	}
-      
-      f->eax = file_read (cur->files[id], buf, size);
+	f->eax = -1;
+      else
+	f->eax = file_read (cur->files[id], buf, size);
     }
   else
     f->eax = -1;
+
+  unpin_user_buffer (buf, size);
 }
 
 static void
@@ -193,9 +302,8 @@ syscall_write (struct intr_frame *f)
   size = (unsigned)*esp;
 
   /* Check so that buf lies in userspace */
-  CHECK_POINTER (buf);
-  CHECK_POINTER (buf + size - 1);
-  
+  CHECK_BUFFER (buf, size, false);
+
   if (fd == STDOUT_FILENO)
     {
       putbuf (buf, size);
@@ -207,15 +315,21 @@ syscall_write (struct intr_frame *f)
       int id = fd - FILE_ID_OFFSET;
 
       if (!bitmap_test (cur->files_bitmap, id))
-	{
-	  f->eax = -1;
-	  return;
-	}
-      
-      f->eax = file_write (cur->files[id], buf, size);
+	f->eax = -1;
+      else
+        {
+	  f->eax = file_write (cur->files[id], buf, size);
+#ifdef VM
+          /* Pages of the file read ahead before the write must
+             not be mapped after it. */
+          frame_invalidate (file_get_inode (cur->files[id]));
+#endif
+        }
     }
   else
     f->eax = -1;
+
+  unpin_user_buffer (buf, size);
 }
 
 static void
@@ -302,6 +416,18 @@ syscall_remove (struct intr_frame *f)
   CHECK_POINTER (name);
   CHECK_STRING (name);
 
+#ifdef VM
+  {
+    /* Let go of the file's pages that no process maps, so that
+       its sectors are freed once the last mapping is gone. */
+    struct file *file = filesys_open (name);
+    if (file != NULL)
+      {
+        frame_invalidate (file_get_inode (file));
+        file_close (file);
+      }
+  }
+#endif
   f->eax = filesys_remove (name);
 }
 
@@ -395,6 +521,52 @@ syscall_close (struct intr_frame *f)
     }
 }
 
+#ifdef VM
+static void
+syscall_mmap (struct intr_frame *f)
+{
+  int32_t *esp;
+  int fd;
+  void *addr;
+
+  esp = f->esp;
+  esp++;
+  CHECK_POINTER (esp + 1);
+
+  fd = (int)*esp++;
+  addr = (void *)*esp;
+
+  if (fd >= FILE_ID_OFFSET && fd < (FILE_ID_OFFSET + MAX_FILES))
+    {
+      struct thread *cur = thread_current ();
+      int id = fd - FILE_ID_OFFSET;
+
+      if (bitmap_test (cur->files_bitmap, id))
+        {
+          f->eax = mmap_map (cur->files[id], addr);
+          return;
+        }
+    }
+
+  f->eax = MAP_FAILED;
+}
+
+static void
+syscall_munmap (struct intr_frame *f)
+{
+  int32_t *esp;
+  mapid_t mapping;
+
+  esp = f->esp;
+  esp++;
+  CHECK_POINTER (esp);
+
+  mapping = (mapid_t)*esp;
+
+  mmap_unmap (mapping);
+}
+#endif
+
 static void
 syscall_handler (struct intr_frame *f) 
 {
@@ -402,6 +574,9 @@ syscall_handler (struct intr_frame *f)
   int syscall_nr;
 
   esp = f->esp;
+#ifdef VM
+  thread_current ()->user_esp = esp;
+#endif
   CHECK_POINTER (esp);
   syscall_nr = *esp;
 
@@ -446,6 +621,14 @@ syscall_handler (struct intr_frame *f)
     case SYS_CLOSE:
       syscall_close (f);
       break;
+#ifdef VM
+    case SYS_MMAP:
+      syscall_mmap (f);
+      break;
+    case SYS_MUNMAP:
+      syscall_munmap (f);
+      break;
+#endif
     default:
       printf ("Syscall nr: %d is not implemented!", syscall_nr);
       thread_exit (-1);
@@ -0,0 +1,753 @@
+#include "vm/frame.h"
+#include <debug.h>
+#include <stdio.h>
+#include <string.h>
+#include "filesys/file.h"
+#include "filesys/inode.h"
+#include "threads/malloc.h"
+#include "threads/slab.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "threads/workqueue.h"
+#include "userprog/pagedir.h"
+#include "vm/page.h"
+
+/* Frame table.
+
+   Every user pool page that holds a process's page is in the
+   frame table.  When the user pool is exhausted, a frame is
+   taken away from the pages in it, chosen by the "clock" or
+   "second chance" algorithm: the hand sweeps around the table,
+   clearing the accessed bits of the pages it passes, and stops
+   at the first frame that none of its pages has accessed since
+   the hand last passed it.
+
+   A frame is pinned from the moment it is allocated until the
+   page in it has been filled and mapped, while it is being
+   evicted, and while it is being written back to its file, so
+   that the hand passes it by.  A process that wants to map a
+   pinned shared frame waits until it is unpinned.
+
+   A frame is also wired while a system call reads or writes one
+   of its pages, so that the kernel does not fault on the page
+   while the file system holds a disk or inode lock.  A wired
+   frame is not evicted, but unlike a pinned one, it can still
+   be mapped by other processes.
+
+   A shared frame may also be filled ahead of time by the
+   prefetch thread, before any page is mapped to it, in which
+   case it stays in the shared frame table with an empty list of
+   pages until a process maps it, it is evicted, or its file is
+   written or removed.  Each shared frame keeps its own handle on
+   the file, so that the file's inode, and thus its sector,
+   cannot be reused while the frame exists. */
+
+static struct list frames;              /* All frames. */
+static struct list_elem *hand;          /* Clock hand, or list end. */
+static struct hash shared_frames;       /* Shared frames. */
+static struct lock frame_lock;          /* Protects all of the above. */
+static struct condition frame_unpinned; /* Signaled when a shared frame
+                                           is unpinned or removed. */
+static struct kmem_cache *frame_cache;  /* Cache of struct frame. */
+static struct workqueue *prefetch_wq;   /* Runs prefetch requests. */
+static unsigned invalidate_cnt;         /* Calls to frame_invalidate(). */
+
+/* A request to read a page of a file into a shared frame. */
+struct prefetch
+  {
+    struct work work;           /* Work item. */
+    struct frame key;           /* Shared frame table key and file. */
+  };
+
+/* Statistics. */
+static long long evict_cnt;             /* Frames chosen for eviction. */
+static long long share_cnt;             /* Faults served by a shared frame. */
+static long long prefetch_cnt;          /* Pages read by prefetching. */
+static long long prefetch_hit_cnt;      /* Prefetched pages later mapped. */
+
+static hash_hash_func frame_hash;
+static hash_less_func frame_less;
+static bool set_key (struct frame *, const struct page *);
+static struct frame *shared_lookup (struct frame *key);
+static struct frame *new_frame (void *kpage);
+static struct frame *attach (struct frame *, struct page *,
+                             bool *prefetched);
+static void frame_remove (struct frame *);
+static void frame_destroy (struct frame *);
+static work_func prefetch_page;
+static struct frame *evict (void);
+static bool lock_pages (struct frame *);
+static void unlock_pages (struct frame *);
+static bool test_and_clear_accessed (struct frame *);
+static void evict_shared (struct frame *);
+
+/* Initializes the frame table. */
+void
+frame_init (void)
+{
+  list_init (&frames);
+  hand = list_end (&frames);
+  if (!hash_init (&shared_frames, frame_hash, frame_less, NULL))
+    PANIC ("can't create shared frame table");
+  lock_init (&frame_lock);
+  cond_init (&frame_unpinned);
+  frame_cache = kmem_cache_create ("frame", sizeof (struct frame), NULL);
+  if (frame_cache == NULL)
+    PANIC ("can't create frame cache");
+}
+
+/* Starts the thread that reads prefetched pages.  Must be called
+   after workqueue_init().  Without it, frame_prefetch() does
+   nothing. */
+void
+frame_init_prefetch (void)
+{
+  prefetch_wq = workqueue_create ("prefetch", PRI_DEFAULT);
+}
+
+/* Allocates a private frame for PAGE, evicting another page if
+   the user pool is exhausted.  If FLAGS includes PAL_ZERO, the
+   frame is zeroed.  Returns the frame, pinned, with PAGE, if it
+   is nonnull, in its list of pages, or a null pointer if no
+   frame could be allocated or freed up. */
+struct frame *
+frame_alloc (struct page *page, enum palloc_flags flags)
+{
+  struct frame *f;
+  void *kpage;
+
+  kpage = palloc_get_page (PAL_USER | (flags & PAL_ZERO));
+  if (kpage != NULL)
+    {
+      f = new_frame (kpage);
+      if (f == NULL)
+        return NULL;
+    }
+  else
+    {
+      f = evict ();
+      if (f == NULL)
+        return NULL;
+      if (flags & PAL_ZERO)
+        memset (f->kpage, 0, PGSIZE);
+    }
+  if (page != NULL)
+    list_push_back (&f->pages, &page->frame_elem);
+  return f;
+}
+
+/* Returns the shared frame for PAGE, which must be read from a
+   file, with PAGE added to its list of pages.  If no process has
+   the same page of the same file in memory, allocates a new
+   frame, enters it in the shared frame table, sets *FRESH to
+   true, and returns the frame pinned; the caller must fill it
+   and then unpin it, or free it.  Otherwise, sets *FRESH to
+   false and returns the existing frame, which is already filled,
+   and sets *PREFETCHED to true if it was filled by prefetching
+   and PAGE is the first page to map it.  Returns a null pointer
+   if no frame could be allocated. */
+struct frame *
+frame_share (struct page *page, bool *fresh, bool *prefetched)
+{
+  struct frame key, *f;
+
+  if (!set_key (&key, page))
+    return NULL;
+
+  for (;;)
+    {
+      lock_acquire (&frame_lock);
+      while ((f = shared_lookup (&key)) != NULL && f->pinned)
+        cond_wait (&frame_unpinned, &frame_lock);
+      if (f != NULL)
+        {
+          attach (f, page, prefetched);
+          lock_release (&frame_lock);
+          *fresh = false;
+          return f;
+        }
+      lock_release (&frame_lock);
+
+      /* Allocating may evict, which takes FRAME_LOCK. */
+      f = frame_alloc (page, 0);
+      if (f == NULL)
+        return NULL;
+
+      lock_acquire (&frame_lock);
+      if (shared_lookup (&key) == NULL)
+        {
+          f->file = file_reopen (page->file);
+          if (f->file == NULL)
+            {
+              lock_release (&frame_lock);
+              frame_free (f);
+              return NULL;
+            }
+          f->shared = true;
+          f->sector = key.sector;
+          f->file_ofs = key.file_ofs;
+          f->read_bytes = key.read_bytes;
+          f->writable = key.writable;
+          hash_insert (&shared_frames, &f->hash_elem);
+          lock_release (&frame_lock);
+          *fresh = true;
+          *prefetched = false;
+          return f;
+        }
+
+      /* Another process brought the page in while we were
+         allocating.  Use its frame instead. */
+      list_remove (&page->frame_elem);
+      frame_remove (f);
+      lock_release (&frame_lock);
+      frame_destroy (f);
+    }
+}
+
+/* Returns the shared frame for PAGE, which must be read from a
+   file, with PAGE added to its list of pages, if one is already
+   in memory and filled, and sets *PREFETCHED as frame_share()
+   does.  Otherwise, returns a null pointer without waiting or
+   reading anything. */
+struct frame *
+frame_lookup_shared (struct page *page, bool *prefetched)
+{
+  struct frame key, *f;
+
+  if (!set_key (&key, page))
+    return NULL;
+
+  lock_acquire (&frame_lock);
+  f = shared_lookup (&key);
+  if (f != NULL && !f->pinned)
+    attach (f, page, prefetched);
+  else
+    f = NULL;
+  lock_release (&frame_lock);
+  return f;
+}
+
+/* Starts reading PAGE, which must be read from a file, into a
+   shared frame in the background, unless it is already in
+   memory, so that a later fault on it or on another mapping of
+   the same page of the file does not have to wait for the
+   disk. */
+void
+frame_prefetch (struct page *page)
+{
+  struct prefetch *pf;
+
+  if (prefetch_wq == NULL)
+    return;
+
+  pf = malloc (sizeof *pf);
+  if (pf == NULL)
+    return;
+  if (!set_key (&pf->key, page))
+    {
+      free (pf);
+      return;
+    }
+  pf->key.file = file_reopen (page->file);
+  if (pf->key.file == NULL)
+    {
+      free (pf);
+      return;
+    }
+  work_init (&pf->work, prefetch_page, pf);
+  work_queue (prefetch_wq, &pf->work);
+}
+
+/* Discards the shared frames of INODE that no page is mapped to,
+   such as pages read ahead that no process has touched yet, so
+   that they are not mapped again after the file has been
+   written or removed.  Also keeps prefetch requests that are
+   reading INODE right now from entering what they read in the
+   shared frame table. */
+void
+frame_invalidate (struct inode *inode)
+{
+  disk_sector_t sector = inode_get_inumber (inode);
+  struct list discarded;
+  struct list_elem *e, *next;
+
+  list_init (&discarded);
+  lock_acquire (&frame_lock);
+  invalidate_cnt++;
+  for (e = list_begin (&frames); e != list_end (&frames); e = next)
+    {
+      struct frame *f = list_entry (e, struct frame, elem);
+
+      next = list_next (e);
+      if (f->shared && f->sector == sector && list_empty (&f->pages)
+          && !f->pinned && f->wire_cnt == 0)
+        {
+          frame_remove (f);
+          list_push_back (&discarded, &f->elem);
+        }
+    }
+  lock_release (&frame_lock);
+
+  while (!list_empty (&discarded))
+    frame_destroy (list_entry (list_pop_front (&discarded),
+                               struct frame, elem));
+}
+
+/* Frees F, which must be pinned, because the page that it was
+   allocated for could not be filled or mapped. */
+void
+frame_free (struct frame *f)
+{
+  ASSERT (f != NULL);
+  ASSERT (f->pinned);
+
+  lock_acquire (&frame_lock);
+  list_init (&f->pages);
+  frame_remove (f);
+  lock_release (&frame_lock);
+
+  frame_destroy (f);
+}
+
+/* Unmaps PAGE, which must be locked, from F, and frees F if no
+   other page is mapped to it.  A shared frame that has been
+   modified is first written back to its file. */
+void
+frame_release (struct frame *f, struct page *page)
+{
+  bool last;
+
+  ASSERT (lock_held_by_current_thread (&page->lock));
+
+  lock_acquire (&frame_lock);
+
+  /* Only another page's write-back can have F pinned. */
+  while (f->pinned)
+    cond_wait (&frame_unpinned, &frame_lock);
+
+  pagedir_clear_page (page->pagedir, page->upage);
+  if (pagedir_is_dirty (page->pagedir, page->upage))
+    f->dirty = true;
+  list_remove (&page->frame_elem);
+  page->frame = NULL;
+
+  if (f->shared && f->dirty)
+    {
+      f->pinned = true;
+      f->dirty = false;
+      lock_release (&frame_lock);
+      file_write_at (f->file, f->kpage, f->read_bytes, f->file_ofs);
+      frame_invalidate (file_get_inode (f->file));
+      lock_acquire (&frame_lock);
+      f->pinned = false;
+      cond_broadcast (&frame_unpinned, &frame_lock);
+    }
+
+  last = list_empty (&f->pages);
+  if (last)
+    frame_remove (f);
+  lock_release (&frame_lock);
+
+  if (last)
+    frame_destroy (f);
+}
+
+/* Allows F to be evicted, and a shared F to be mapped. */
+void
+frame_unpin (struct frame *f)
+{
+  ASSERT (f->pinned);
+
+  if (f->shared)
+    {
+      lock_acquire (&frame_lock);
+      f->pinned = false;
+      cond_broadcast (&frame_unpinned, &frame_lock);
+      lock_release (&frame_lock);
+    }
+  else
+    f->pinned = false;
+}
+
+/* Keeps F, which must be mapped to a page, from being evicted
+   until a matching call to frame_unwire().  Calls nest. */
+void
+frame_wire (struct frame *f)
+{
+  lock_acquire (&frame_lock);
+  f->wire_cnt++;
+  lock_release (&frame_lock);
+}
+
+/* Undoes one call to frame_wire() on F. */
+void
+frame_unwire (struct frame *f)
+{
+  lock_acquire (&frame_lock);
+  ASSERT (f->wire_cnt > 0);
+  f->wire_cnt--;
+  lock_release (&frame_lock);
+}
+
+/* Prints frame table statistics. */
+void
+frame_print_stats (void)
+{
+  printf ("Frames: %zu in use, %zu shared, %lld evictions, "
+          "%lld faults served by shared frames\n",
+          list_size (&frames), hash_size (&shared_frames),
+          evict_cnt, share_cnt);
+  printf ("Prefetch: %lld pages read, %lld used\n",
+          prefetch_cnt, prefetch_hit_cnt);
+}
+
+/* Sets the shared frame table key in F to the part of the file
+   that PAGE holds.  Returns false if PAGE is not read from a
+   file. */
+static bool
+set_key (struct frame *f, const struct page *page)
+{
+  if (page->file == NULL)
+    return false;
+  f->sector = inode_get_inumber (file_get_inode (page->file));
+  f->file_ofs = page->file_ofs;
+  f->read_bytes = page->read_bytes;
+  f->writable = page->writable;
+  return true;
+}
+
+/* Returns the frame in the shared frame table with the same key
+   as KEY, or a null pointer if there is none.  FRAME_LOCK must
+   be held. */
+static struct frame *
+shared_lookup (struct frame *key)
+{
+  struct hash_elem *e = hash_find (&shared_frames, &key->hash_elem);
+  return e != NULL ? hash_entry (e, struct frame, hash_elem) : NULL;
+}
+
+/* Adds PAGE to the list of pages of shared frame F, which must
+   be filled, and sets *PREFETCHED to true if F was filled by
+   prefetching and PAGE is the first page to map it, false
+   otherwise.  Returns F.  FRAME_LOCK must be held. */
+static struct frame *
+attach (struct frame *f, struct page *page, bool *prefetched)
+{
+  list_push_back (&f->pages, &page->frame_elem);
+  share_cnt++;
+  *prefetched = f->prefetched;
+  if (f->prefetched)
+    {
+      f->prefetched = false;
+      prefetch_hit_cnt++;
+    }
+  return f;
+}
+
+/* Removes F, whose list of pages must be empty, from the frame
+   table and, if it is shared, from the shared frame table, and
+   wakes up anyone waiting for it.  FRAME_LOCK must be held. */
+static void
+frame_remove (struct frame *f)
+{
+  ASSERT (list_empty (&f->pages));
+
+  if (f->shared)
+    {
+      hash_delete (&shared_frames, &f->hash_elem);
+      f->shared = false;
+      cond_broadcast (&frame_unpinned, &frame_lock);
+    }
+  if (hand == &f->elem)
+    hand = list_next (hand);
+  list_remove (&f->elem);
+}
+
+/* Adds a new frame for user pool page KPAGE to the frame table
+   and returns it, pinned, with an empty list of pages.  Returns
+   a null pointer, and frees KPAGE, if memory is not available. */
+static struct frame *
+new_frame (void *kpage)
+{
+  struct frame *f = kmem_cache_alloc (frame_cache);
+  if (f == NULL)
+    {
+      palloc_free_page (kpage);
+      return NULL;
+    }
+  f->kpage = kpage;
+  list_init (&f->pages);
+  f->pinned = true;
+  f->wire_cnt = 0;
+  f->shared = false;
+  f->file = NULL;
+  f->prefetched = false;
+  f->dirty = false;
+
+  lock_acquire (&frame_lock);
+  list_push_back (&frames, &f->elem);
+  lock_release (&frame_lock);
+  return f;
+}
+
+/* Closes F's file, if any, and frees F, which must already have
+   been removed from the frame table. */
+static void
+frame_destroy (struct frame *f)
+{
+  file_close (f->file);
+  palloc_free_page (f->kpage);
+  kmem_cache_free (frame_cache, f);
+}
+
+/* Work function that reads the page described by prefetch
+   request PF_ into a new shared frame, unless it is already in
+   memory.  Prefetching never evicts anything, so it gives up if
+   the user pool is exhausted.  The frame enters the shared frame
+   table only once it is filled, and not at all if the file may
+   have been written or removed while it was being read. */
+static void
+prefetch_page (void *pf_)
+{
+  struct prefetch *pf = pf_;
+  struct frame *key = &pf->key;
+  struct frame *f;
+  unsigned invalidate_start;
+  void *kpage;
+
+  lock_acquire (&frame_lock);
+  f = shared_lookup (key);
+  invalidate_start = invalidate_cnt;
+  lock_release (&frame_lock);
+  if (f != NULL)
+    goto done;
+
+  kpage = palloc_get_page (PAL_USER);
+  if (kpage == NULL)
+    goto done;
+  f = new_frame (kpage);
+  if (f == NULL)
+    goto done;
+
+  if (file_read_at (key->file, f->kpage, key->read_bytes, key->file_ofs)
+      != (off_t) key->read_bytes)
+    {
+      frame_free (f);
+      goto done;
+    }
+  memset ((uint8_t *) f->kpage + key->read_bytes, 0,
+          PGSIZE - key->read_bytes);
+
+  lock_acquire (&frame_lock);
+  if (invalidate_cnt != invalidate_start || shared_lookup (key) != NULL)
+    {
+      lock_release (&frame_lock);
+      frame_free (f);
+      goto done;
+    }
+  f->shared = true;
+  f->sector = key->sector;
+  f->file_ofs = key->file_ofs;
+  f->read_bytes = key->read_bytes;
+  f->writable = key->writable;
+  f->file = key->file;
+  key->file = NULL;
+  f->prefetched = true;
+  f->pinned = false;
+  hash_insert (&shared_frames, &f->hash_elem);
+  prefetch_cnt++;
+  lock_release (&frame_lock);
+
+ done:
+  file_close (key->file);
+  free (pf);
+}
+
+/* Chooses a frame to evict with the clock algorithm, writes its
+   contents out if necessary, and returns it, pinned, with an
+   empty list of pages.  Returns a null pointer if no frame can
+   be evicted. */
+static struct frame *
+evict (void)
+{
+  size_t tries;
+
+  lock_acquire (&frame_lock);
+
+  /* Two sweeps clear every accessed bit, so one frame must come
+     up in the third, unless they are all pinned, wired or
+     busy. */
+  for (tries = 3 * list_size (&frames); tries > 0; tries--)
+    {
+      struct frame *f;
+      struct page *p;
+
+      if (hand == list_end (&frames))
+        hand = list_begin (&frames);
+      if (hand == list_end (&frames))
+        break;
+      f = list_entry (hand, struct frame, elem);
+      hand = list_next (hand);
+
+      if (f->pinned || f->wire_cnt > 0 || !lock_pages (f))
+        continue;
+      if (test_and_clear_accessed (f))
+        {
+          unlock_pages (f);
+          continue;
+        }
+
+      /* Found a victim.  Pin it so that the hand passes it by,
+         and write it out without holding up the rest of the
+         frame table. */
+      f->pinned = true;
+      evict_cnt++;
+      lock_release (&frame_lock);
+
+      if (f->shared)
+        evict_shared (f);
+      else
+        {
+          p = list_entry (list_front (&f->pages), struct page, frame_elem);
+          if (!page_out (p))
+            {
+              f->pinned = false;
+              page_unlock (p);
+              return NULL;
+            }
+          list_remove (&p->frame_elem);
+          page_unlock (p);
+        }
+      f->dirty = false;
+      return f;
+    }
+
+  lock_release (&frame_lock);
+  return NULL;
+}
+
+/* Tries to lock every page mapped to F.  Returns true if
+   successful.  Otherwise, locks none of them and returns
+   false. */
+static bool
+lock_pages (struct frame *f)
+{
+  struct list_elem *e, *locked;
+
+  for (e = list_begin (&f->pages); e != list_end (&f->pages);
+       e = list_next (e))
+    if (!page_try_lock (list_entry (e, struct page, frame_elem)))
+      break;
+  if (e == list_end (&f->pages))
+    return true;
+
+  locked = e;
+  for (e = list_begin (&f->pages); e != locked; e = list_next (e))
+    page_unlock (list_entry (e, struct page, frame_elem));
+  return false;
+}
+
+/* Unlocks every page mapped to F. */
+static void
+unlock_pages (struct frame *f)
+{
+  struct list_elem *e;
+
+  for (e = list_begin (&f->pages); e != list_end (&f->pages);
+       e = list_next (e))
+    page_unlock (list_entry (e, struct page, frame_elem));
+}
+
+/* Returns true if any page mapped to F has been accessed since
+   the last call, and clears their accessed bits. */
+static bool
+test_and_clear_accessed (struct frame *f)
+{
+  struct list_elem *e;
+  bool accessed = false;
+
+  for (e = list_begin (&f->pages); e != list_end (&f->pages);
+       e = list_next (e))
+    {
+      struct page *p = list_entry (e, struct page, frame_elem);
+      if (pagedir_is_accessed (p->pagedir, p->upage))
+        {
+          pagedir_set_accessed (p->pagedir, p->upage, false);
+          accessed = true;
+        }
+    }
+  return accessed;
+}
+
+/* Evicts shared frame F, which must be pinned and whose pages
+   must be locked: unmaps it from all of its pages, if any,
+   writes it back to its file if any of them modified it, unlocks
+   the pages, removes F from the shared frame table, and closes
+   its file. */
+static void
+evict_shared (struct frame *f)
+{
+  struct list_elem *e;
+  struct page *p;
+  bool dirty = f->dirty;
+
+  /* Unmap the pages first, so that their owners cannot modify
+     the frame after we check whether it is dirty. */
+  for (e = list_begin (&f->pages); e != list_end (&f->pages);
+       e = list_next (e))
+    {
+      p = list_entry (e, struct page, frame_elem);
+      pagedir_clear_page (p->pagedir, p->upage);
+      if (pagedir_is_dirty (p->pagedir, p->upage))
+        dirty = true;
+    }
+  if (dirty)
+    {
+      file_write_at (f->file, f->kpage, f->read_bytes, f->file_ofs);
+      frame_invalidate (file_get_inode (f->file));
+    }
+
+  while (!list_empty (&f->pages))
+    {
+      p = list_entry (list_pop_front (&f->pages), struct page, frame_elem);
+      p->frame = NULL;
+      page_unlock (p);
+    }
+
+  lock_acquire (&frame_lock);
+  hash_delete (&shared_frames, &f->hash_elem);
+  f->shared = false;
+  f->prefetched = false;
+  cond_broadcast (&frame_unpinned, &frame_lock);
+  lock_release (&frame_lock);
+
+  file_close (f->file);
+  f->file = NULL;
+}
+
+/* Returns a hash value for shared frame F_. */
+static unsigned
+frame_hash (const struct hash_elem *f_, void *aux UNUSED)
+{
+  const struct frame *f = hash_entry (f_, struct frame, hash_elem);
+  return hash_int (f->sector) ^ hash_int (f->file_ofs);
+}
+
+/* Returns true if shared frame A precedes shared frame B. */
+static bool
+frame_less (const struct hash_elem *a_, const struct hash_elem *b_,
+            void *aux UNUSED)
+{
+  const struct frame *a = hash_entry (a_, struct frame, hash_elem);
+  const struct frame *b = hash_entry (b_, struct frame, hash_elem);
+
+  if (a->sector != b->sector)
+    return a->sector < b->sector;
+  else if (a->file_ofs != b->file_ofs)
+    return a->file_ofs < b->file_ofs;
+  else if (a->read_bytes != b->read_bytes)
+    return a->read_bytes < b->read_bytes;
+  else
+    return a->writable < b->writable;
+}
@@ -0,0 +1,64 @@
+#ifndef VM_FRAME_H
+#define VM_FRAME_H
+
+#include <hash.h>
+#include <list.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "devices/disk.h"
+#include "filesys/off_t.h"
+#include "threads/palloc.h"
+
+struct file;
+struct inode;
+struct page;
+
+/* A frame: a page of the user pool that holds a user page.
+
+   A private frame holds one process's page.  A shared frame
+   holds a page of a file and is mapped by every process that
+   maps that page of the file, so it has a list of pages, whose
+   length serves as its reference count.  It is found through
+   the shared frame table by the file's inode sector, the offset
+   of the page in the file, the number of bytes that came from
+   the file, and whether it is writable: read-only pages of
+   executables are shared among the processes that run them,
+   and writable pages of memory-mapped files among the processes
+   that map them, but the two are kept apart so that writing to
+   a mapped executable cannot change the code of running
+   processes. */
+struct frame
+  {
+    struct list_elem elem;      /* Element in the frame table. */
+    void *kpage;                /* Kernel virtual address. */
+    struct list pages;          /* Pages mapped to the frame. */
+    bool pinned;                /* Not to be evicted or mapped? */
+    unsigned wire_cnt;          /* Pages wired by system calls. */
+
+    /* Shared frames only. */
+    bool shared;                /* In the shared frame table? */
+    struct hash_elem hash_elem; /* Element in the shared frame table. */
+    disk_sector_t sector;       /* File's inode sector. */
+    off_t file_ofs;             /* Offset in the file. */
+    size_t read_bytes;          /* Bytes from the file; the rest are zero. */
+    bool writable;              /* Mapped writable? */
+    struct file *file;          /* Own handle on the file. */
+    bool prefetched;            /* Filled by prefetching, not yet mapped? */
+    bool dirty;                 /* Modified through an unmapped page? */
+  };
+
+void frame_init (void);
+void frame_init_prefetch (void);
+struct frame *frame_alloc (struct page *, enum palloc_flags);
+struct frame *frame_share (struct page *, bool *fresh, bool *prefetched);
+struct frame *frame_lookup_shared (struct page *, bool *prefetched);
+void frame_prefetch (struct page *);
+void frame_invalidate (struct inode *);
+void frame_free (struct frame *);
+void frame_release (struct frame *, struct page *);
+void frame_unpin (struct frame *);
+void frame_wire (struct frame *);
+void frame_unwire (struct frame *);
+void frame_print_stats (void);
+
+#endif /* vm/frame.h */
@@ -0,0 +1,137 @@
+#include "vm/mmap.h"
+#include <debug.h>
+#include <list.h>
+#include <round.h>
+#include "filesys/file.h"
+#include "threads/malloc.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "vm/page.h"
+
+/* Memory-mapped files.
+
+   Each process keeps a list of the files that it has mapped.
+   Mapping a file only enters its pages in the supplemental page
+   table, as pages of type PAGE_MMAP; they are read when they are
+   first touched, and written back when they are unmapped. */
+
+/* A mapped file. */
+struct mapping
+  {
+    struct list_elem elem;      /* Element in thread's mappings list. */
+    mapid_t id;                 /* Map region identifier. */
+    struct file *file;          /* Mapped file, reopened. */
+    uint8_t *base;              /* First user page. */
+    size_t page_cnt;            /* Number of pages. */
+  };
+
+static struct mapping *mapping_lookup (mapid_t);
+static void unmap (struct mapping *);
+
+/* Maps all of FILE into the current process's address space
+   starting at page-aligned user address ADDR.  Returns the new
+   mapping's identifier, or MAP_FAILED if ADDR is null or not
+   page-aligned, if FILE is empty, if any page of the range is
+   already in use or outside user space, or if memory is not
+   available.  FILE may be closed afterward without affecting
+   the mapping. */
+mapid_t
+mmap_map (struct file *file, void *addr)
+{
+  struct thread *t = thread_current ();
+  struct mapping *m;
+  off_t length;
+  size_t i;
+
+  length = file_length (file);
+  if (addr == NULL || pg_ofs (addr) != 0 || length == 0)
+    return MAP_FAILED;
+
+  m = malloc (sizeof *m);
+  if (m == NULL)
+    return MAP_FAILED;
+  m->base = addr;
+  m->page_cnt = DIV_ROUND_UP (length, PGSIZE);
+  m->file = file_reopen (file);
+  if (m->file == NULL)
+    {
+      free (m);
+      return MAP_FAILED;
+    }
+
+  for (i = 0; i < m->page_cnt; i++)
+    {
+      uint8_t *upage = m->base + i * PGSIZE;
+      off_t ofs = i * PGSIZE;
+      size_t read_bytes = length - ofs < PGSIZE ? length - ofs : PGSIZE;
+
+      if (!is_user_vaddr (upage) || upage < m->base
+          || !page_add_mmap (upage, m->file, ofs, read_bytes))
+        {
+          m->page_cnt = i;
+          unmap (m);
+          return MAP_FAILED;
+        }
+    }
+
+  m->id = t->next_mapid++;
+  list_push_back (&t->mappings, &m->elem);
+  return m->id;
+}
+
+/* Unmaps the current process's mapping MAPPING, writing back
+   the pages that have been modified.  Returns false if there is
+   no such mapping. */
+bool
+mmap_unmap (mapid_t mapping)
+{
+  struct mapping *m = mapping_lookup (mapping);
+
+  if (m == NULL)
+    return false;
+  list_remove (&m->elem);
+  unmap (m);
+  return true;
+}
+
+/* Unmaps all of the current process's mappings. */
+void
+mmap_unmap_all (void)
+{
+  struct thread *t = thread_current ();
+
+  while (!list_empty (&t->mappings))
+    unmap (list_entry (list_pop_front (&t->mappings),
+                       struct mapping, elem));
+}
+
+/* Returns the current process's mapping with identifier ID, or
+   a null pointer if there is none. */
+static struct mapping *
+mapping_lookup (mapid_t id)
+{
+  struct thread *t = thread_current ();
+  struct list_elem *e;
+
+  for (e = list_begin (&t->mappings); e != list_end (&t->mappings);
+       e = list_next (e))
+    {
+      struct mapping *m = list_entry (e, struct mapping, elem);
+      if (m->id == id)
+        return m;
+    }
+  return NULL;
+}
+
+/* Removes M's pages from the page table, closes its file, and
+   frees it.  M must not be in a list. */
+static void
+unmap (struct mapping *m)
+{
+  size_t i;
+
+  for (i = 0; i < m->page_cnt; i++)
+    page_remove (m->base + i * PGSIZE);
+  file_close (m->file);
+  free (m);
+}
@@ -0,0 +1,641 @@
+#include "vm/page.h"
+#include <debug.h>
+#include <stdio.h>
+#include <string.h>
+#include "filesys/file.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/slab.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "userprog/pagedir.h"
+#include "vm/frame.h"
+#include "vm/swap.h"
+
+/* Cache of struct page. */
+static struct kmem_cache *page_cache;
+
+/* The zero page: a frame of zeros that is never written.  A
+   page that would start out as all zeros is mapped to it,
+   read-only, until the process first writes to it, and only
+   then gets a frame of its own. */
+static void *zero_kpage;
+
+/* Size of the aligned window of pages around a fault on a page
+   of a file within which pages that are already in memory are
+   mapped too, and of the window of pages read ahead of a
+   sequential scan. */
+#define FAULT_AROUND_PAGES 8
+
+/* If true, each process prints its page fault counts when it
+   exits.  Set by the -pf option. */
+bool page_fault_report;
+
+/* Maximum size of a process's stack, in pages.  The stack grows
+   on demand, a page at a time, up to this size. */
+size_t stack_page_limit = 2048;
+
+/* Statistics. */
+static long long major_cnt;             /* Page-ins that read the disk. */
+static long long minor_cnt;             /* Page-ins without disk reads. */
+static long long around_cnt;            /* Pages mapped around faults. */
+static long long stack_grow_cnt;        /* Stack pages added on demand. */
+static long long zero_map_cnt;          /* Pages mapped to the zero page. */
+static long long zero_copy_cnt;         /* Zero page copies on write. */
+
+static kmem_ctor page_ctor;
+static hash_hash_func page_hash;
+static hash_less_func page_less;
+static hash_action_func page_destroy;
+static struct page *page_add (void *upage, bool writable);
+static bool page_load (struct page *, void *kpage);
+static bool is_zero (const struct page *);
+static bool is_shared (const struct page *);
+static void count_fault (bool major, bool prefetched);
+static void fault_around (struct page *);
+static bool is_stack_access (const void *addr);
+
+/* Initializes the supplemental page table module. */
+void
+page_init (void) 
+{
+  page_cache = kmem_cache_create ("page", sizeof (struct page), page_ctor);
+  if (page_cache == NULL)
+    PANIC ("can't create page cache");
+  zero_kpage = palloc_get_page (PAL_USER | PAL_ZERO);
+  if (zero_kpage == NULL)
+    PANIC ("can't allocate zero page");
+}
+
+/* Constructor for page_cache.  A page's lock is released before
+   the page is freed, so it only needs to be initialized once. */
+static void
+page_ctor (void *p_) 
+{
+  struct page *p = p_;
+
+  lock_init (&p->lock);
+}
+
+/* Creates and returns a new, empty supplemental page table, or
+   a null pointer if memory is not available. */
+struct hash *
+page_table_create (void) 
+{
+  struct hash *pages = malloc (sizeof *pages);
+  if (pages != NULL && !hash_init (pages, page_hash, page_less, NULL)) 
+    {
+      free (pages);
+      pages = NULL;
+    }
+  return pages;
+}
+
+/* Destroys supplemental page table PAGES, freeing the frames and
+   swap slots that its pages occupy and unmapping them from their
+   page directory, which must still exist. */
+void
+page_table_destroy (struct hash *pages) 
+{
+  if (pages != NULL) 
+    {
+      hash_destroy (pages, page_destroy);
+      free (pages);
+    }
+}
+
+/* Records that user page UPAGE in the current process is to be
+   filled on first access by reading READ_BYTES bytes from FILE
+   starting at offset OFS, and zeroing the rest of the page.
+   FILE must stay open as long as the process may need it.
+   Returns false if UPAGE is already in the page table or if
+   memory is not available. */
+bool
+page_add_file (void *upage, struct file *file, off_t ofs,
+               size_t read_bytes, bool writable) 
+{
+  struct page *p;
+
+  ASSERT (file != NULL);
+  ASSERT (read_bytes <= PGSIZE);
+
+  p = page_add (upage, writable);
+  if (p == NULL)
+    return false;
+  p->type = PAGE_FILE;
+  p->file = file;
+  p->file_ofs = ofs;
+  p->read_bytes = read_bytes;
+  return true;
+}
+
+/* Records that user page UPAGE in the current process is to be
+   filled with zeros on first access.  Returns false if UPAGE is
+   already in the page table or if memory is not available. */
+bool
+page_add_zero (void *upage, bool writable) 
+{
+  struct page *p = page_add (upage, writable);
+  if (p == NULL)
+    return false;
+  p->type = PAGE_ZERO;
+  return true;
+}
+
+/* Records that user page UPAGE in the current process maps
+   READ_BYTES bytes of FILE starting at offset OFS, followed by
+   zeros.  The page is read on first access, shared with every
+   other mapping of the same bytes, and written back to FILE if
+   it is modified.  FILE must stay open until the page is
+   removed.  Returns false if UPAGE is already in the page table
+   or if memory is not available. */
+bool
+page_add_mmap (void *upage, struct file *file, off_t ofs,
+               size_t read_bytes) 
+{
+  struct page *p;
+
+  ASSERT (file != NULL);
+  ASSERT (read_bytes <= PGSIZE);
+
+  p = page_add (upage, true);
+  if (p == NULL)
+    return false;
+  p->type = PAGE_MMAP;
+  p->file = file;
+  p->file_ofs = ofs;
+  p->read_bytes = read_bytes;
+  return true;
+}
+
+/* Removes the page that contains UPAGE from the current
+   process's page table, if there is one, writing it back to its
+   file if it is a modified page of a mapped file, and releasing
+   its frame or swap slot. */
+void
+page_remove (void *upage) 
+{
+  struct thread *t = thread_current ();
+  struct page *p = page_lookup (upage);
+
+  if (p != NULL) 
+    {
+      hash_delete (t->pages, &p->hash_elem);
+      page_destroy (&p->hash_elem, NULL);
+    }
+}
+
+/* Returns the current process's page table entry for the page
+   that contains UPAGE, or a null pointer if there is none. */
+struct page *
+page_lookup (void *upage) 
+{
+  struct thread *t = thread_current ();
+  struct page p;
+  struct hash_elem *e;
+
+  if (t->pages == NULL)
+    return NULL;
+
+  p.upage = pg_round_down (upage);
+  e = hash_find (t->pages, &p.hash_elem);
+  return e != NULL ? hash_entry (e, struct page, hash_elem) : NULL;
+}
+
+/* Brings the page that contains user address ADDR into a frame
+   and maps it in the current process's page directory, so that
+   it can be written if WRITE is true, or read otherwise.  A page
+   that is still all zeros is mapped to the zero page for
+   reading, and copied to a frame of its own for writing.  If
+   ADDR is not in the page table but looks like an access to the
+   stack, the stack is grown to include it.  After a page of a
+   file is brought in, the pages around it that are already in
+   memory are mapped as well, and if the process seems to be
+   reading through the file, the next pages are read ahead in the
+   background.  Returns true if successful, false if ADDR is not
+   in the page table and not in the stack, if WRITE is true and
+   the page is read-only, or if no frame is available or the page
+   cannot be read. */
+bool
+page_in (void *addr, bool write) 
+{
+  struct page *p = page_lookup (addr);
+  struct frame *f;
+  bool fresh, prefetched = false;
+  bool success = false;
+
+  if (p == NULL) 
+    {
+      if (!is_stack_access (addr))
+        return false;
+      p = page_add (pg_round_down (addr), true);
+      if (p == NULL)
+        return false;
+      p->type = PAGE_ZERO;
+      stack_grow_cnt++;
+    }
+
+  if (write && !p->writable)
+    return false;
+
+  lock_acquire (&p->lock);
+  if (p->frame != NULL || (p->zero_mapped && !write)) 
+    {
+      lock_release (&p->lock);
+      return true;
+    }
+  if (p->zero_mapped) 
+    {
+      /* First write: replace the zero page by a frame of its own,
+         below. */
+      pagedir_clear_page (p->pagedir, p->upage);
+      p->zero_mapped = false;
+      zero_copy_cnt++;
+    }
+  else if (!write && is_zero (p)) 
+    {
+      success = pagedir_set_page (p->pagedir, p->upage, zero_kpage, false);
+      if (success) 
+        {
+          p->zero_mapped = true;
+          zero_map_cnt++;
+          count_fault (false, false);
+        }
+      lock_release (&p->lock);
+      return success;
+    }
+
+  if (is_shared (p))
+    f = frame_share (p, &fresh, &prefetched);
+  else 
+    {
+      /* Pages read from a file are mostly overwritten, so only
+         ask for a zeroed frame if nothing is to be read. */
+      f = frame_alloc (p, is_zero (p) ? PAL_ZERO : 0);
+      fresh = true;
+    }
+  if (f != NULL) 
+    {
+      bool swapped = p->swap_slot != SWAP_NONE;
+      bool major = fresh && (swapped || ((p->type == PAGE_FILE
+                                          || p->type == PAGE_MMAP)
+                                         && p->read_bytes > 0));
+
+      if ((!fresh || page_load (p, f->kpage))
+          && pagedir_set_page (p->pagedir, p->upage, f->kpage, p->writable))
+        {
+          /* A page that came back from swap cannot be recreated
+             from its original source, so mark it dirty to make
+             sure it goes back to swap if it is evicted again. */
+          if (swapped)
+            pagedir_set_dirty (p->pagedir, p->upage, true);
+          p->frame = f;
+          if (fresh)
+            frame_unpin (f);
+          count_fault (major, prefetched);
+          success = true;
+        }
+      else if (fresh)
+        frame_free (f);
+      else
+        frame_release (f, p);
+    }
+  lock_release (&p->lock);
+
+  if (success && is_shared (p))
+    fault_around (p);
+  return success;
+}
+
+/* Brings the page that contains user address ADDR into memory,
+   as page_in() does, and keeps it there until page_unpin() is
+   called, so that the kernel can access it without faulting,
+   for example while the file system holds a disk lock.  A page
+   mapped to the zero page for reading needs nothing more, since
+   the zero page is never evicted.  Returns false if page_in()
+   fails. */
+bool
+page_pin (void *addr, bool write) 
+{
+  for (;;) 
+    {
+      struct page *p;
+      bool present;
+
+      if (!page_in (addr, write))
+        return false;
+
+      /* The page may have been evicted again before we locked
+         it.  Holding its lock keeps it from being evicted while
+         we wire its frame. */
+      p = page_lookup (addr);
+      lock_acquire (&p->lock);
+      present = p->frame != NULL || (p->zero_mapped && !write);
+      if (p->frame != NULL)
+        frame_wire (p->frame);
+      lock_release (&p->lock);
+      if (present)
+        return true;
+    }
+}
+
+/* Allows the page that contains user address ADDR, pinned by
+   page_pin(), to be evicted again. */
+void
+page_unpin (void *addr) 
+{
+  struct page *p = page_lookup (addr);
+
+  ASSERT (p != NULL);
+
+  lock_acquire (&p->lock);
+  if (p->frame != NULL)
+    frame_unwire (p->frame);
+  lock_release (&p->lock);
+}
+
+/* Tries to lock P for moving it between memory and swap, and
+   returns true if successful, false if it is already locked. */
+bool
+page_try_lock (struct page *p) 
+{
+  return lock_try_acquire (&p->lock);
+}
+
+/* Unlocks P. */
+void
+page_unlock (struct page *p) 
+{
+  lock_release (&p->lock);
+}
+
+/* Evicts P, which must be locked and present in a private
+   frame, from the frame: unmaps it, and writes it to swap if it
+   has been modified.
+   Returns true if successful, false if swap is full, in which
+   case P stays where it was. */
+bool
+page_out (struct page *p) 
+{
+  void *kpage;
+
+  ASSERT (lock_held_by_current_thread (&p->lock));
+  ASSERT (p->frame != NULL);
+
+  /* Unmap the page first, so that the owner cannot modify it
+     after we check whether it is dirty. */
+  kpage = p->frame->kpage;
+  pagedir_clear_page (p->pagedir, p->upage);
+  if (pagedir_is_dirty (p->pagedir, p->upage)) 
+    {
+      p->swap_slot = swap_out (kpage);
+      if (p->swap_slot == SWAP_NONE) 
+        {
+          pagedir_set_page (p->pagedir, p->upage, kpage, p->writable);
+          pagedir_set_dirty (p->pagedir, p->upage, true);
+          return false;
+        }
+    }
+  p->frame = NULL;
+  return true;
+}
+
+/* Prints statistics about page faults, the zero page, and the
+   stack. */
+void
+page_print_stats (void) 
+{
+  printf ("Page faults: %lld major, %lld minor, "
+          "%lld more pages mapped around them\n",
+          major_cnt, minor_cnt, around_cnt);
+  printf ("Zero page: %lld mappings, %lld copied on write\n",
+          zero_map_cnt, zero_copy_cnt);
+  printf ("Stack: %lld pages added on demand, limit %zu pages\n",
+          stack_grow_cnt, stack_page_limit);
+}
+
+/* Prints the current process's page fault counts, if the -pf
+   option was given. */
+void
+page_print_process_stats (void) 
+{
+  struct thread *t = thread_current ();
+
+  if (page_fault_report)
+    printf ("%s: %lld major faults, %lld minor faults, "
+            "%lld prefetch hits\n",
+            t->name, t->major_faults, t->minor_faults, t->prefetch_hits);
+}
+
+/* Returns true if P is shared with other processes: a page of a
+   memory-mapped file, or a read-only page of a file, such as an
+   executable's code, which is the same in every process that
+   maps it. */
+static bool
+is_shared (const struct page *p) 
+{
+  return p->type == PAGE_MMAP || (p->type == PAGE_FILE && !p->writable);
+}
+
+/* Counts a page fault in the current process, MAJOR if it had to
+   wait for the disk, and a prefetch hit if PREFETCHED. */
+static void
+count_fault (bool major, bool prefetched) 
+{
+  struct thread *t = thread_current ();
+
+  if (major) 
+    {
+      t->major_faults++;
+      major_cnt++;
+    }
+  else 
+    {
+      t->minor_faults++;
+      minor_cnt++;
+    }
+  if (prefetched)
+    t->prefetch_hits++;
+}
+
+/* Maps the current process's shared pages in the aligned window
+   of FAULT_AROUND_PAGES pages around P, a shared page that was
+   just brought in, whose contents are already in memory, so that
+   touching them will not fault.  If P is not far past the last
+   page that faulted, the process seems to be reading through
+   the file sequentially, so the pages that follow P are read
+   ahead in the background. */
+static void
+fault_around (struct page *p) 
+{
+  struct thread *t = thread_current ();
+  size_t window = FAULT_AROUND_PAGES * PGSIZE;
+  uint8_t *upage = p->upage;
+  uint8_t *start = (uint8_t *) ((uintptr_t) upage & ~(window - 1));
+  uint8_t *end = start + window;
+  uint8_t *last = t->fault_last;
+  uint8_t *a;
+
+  for (a = start; a < end; a += PGSIZE) 
+    {
+      struct page *q = page_lookup (a);
+      struct frame *f;
+      bool prefetched;
+
+      if (q == NULL || q == p || !is_shared (q) || is_zero (q)
+          || q->frame != NULL || q->zero_mapped || !page_try_lock (q))
+        continue;
+      if (q->frame == NULL
+          && (f = frame_lookup_shared (q, &prefetched)) != NULL) 
+        {
+          if (pagedir_set_page (q->pagedir, q->upage, f->kpage, q->writable)) 
+            {
+              q->frame = f;
+              around_cnt++;
+              if (prefetched)
+                t->prefetch_hits++;
+            }
+          else
+            frame_release (f, q);
+        }
+      page_unlock (q);
+    }
+
+  if (last != NULL && upage > last && upage <= last + window) 
+    {
+      /* Skip the pages that the previous faults of the scan
+         already asked for. */
+      a = upage + PGSIZE;
+      end = a + window;
+      if (t->prefetch_end > (void *) a && t->prefetch_end <= (void *) end)
+        a = t->prefetch_end;
+      for (; a < end && is_user_vaddr (a); a += PGSIZE) 
+        {
+          struct page *q = page_lookup (a);
+          if (q != NULL && is_shared (q) && !is_zero (q) && q->frame == NULL)
+            frame_prefetch (q);
+        }
+      t->prefetch_end = a;
+    }
+  t->fault_last = upage;
+}
+
+/* Returns true if user address ADDR is within the current
+   process's maximum stack size of the top of user memory, and
+   no more than 32 bytes below its stack pointer, the most that
+   the PUSHA instruction writes below it before moving it.  An
+   access to such an address grows the stack. */
+static bool
+is_stack_access (const void *addr) 
+{
+  const uint8_t *esp = thread_current ()->user_esp;
+  const uint8_t *a = addr;
+
+  return (is_user_vaddr (a)
+          && (size_t) ((uint8_t *) PHYS_BASE - a) <= stack_page_limit * PGSIZE
+          && a + 32 >= esp);
+}
+
+/* Returns true if P's contents are all zeros because it has
+   never been written or read from a file. */
+static bool
+is_zero (const struct page *p) 
+{
+  return (p->swap_slot == SWAP_NONE
+          && (p->type == PAGE_ZERO
+              || (p->type == PAGE_FILE && p->read_bytes == 0)));
+}
+
+/* Fills KPAGE with the contents of P, from wherever they are.
+   Returns true if successful, false if they could not be read. */
+static bool
+page_load (struct page *p, void *kpage) 
+{
+  if (p->swap_slot != SWAP_NONE) 
+    {
+      swap_in (p->swap_slot, kpage);
+      p->swap_slot = SWAP_NONE;
+    }
+  else if ((p->type == PAGE_FILE || p->type == PAGE_MMAP)
+           && p->read_bytes > 0) 
+    {
+      if (file_read_at (p->file, kpage, p->read_bytes, p->file_ofs)
+          != (off_t) p->read_bytes)
+        return false;
+      memset ((uint8_t *) kpage + p->read_bytes, 0, PGSIZE - p->read_bytes);
+    }
+  return true;
+}
+
+/* Adds and returns a new page table entry for UPAGE in the
+   current process, or returns a null pointer if there already is
+   one or if memory is not available. */
+static struct page *
+page_add (void *upage, bool writable) 
+{
+  struct thread *t = thread_current ();
+  struct page *p;
+
+  ASSERT (pg_ofs (upage) == 0);
+  ASSERT (is_user_vaddr (upage));
+  ASSERT (t->pages != NULL);
+
+  p = kmem_cache_alloc (page_cache);
+  if (p == NULL)
+    return NULL;
+  p->upage = upage;
+  p->pagedir = t->pagedir;
+  p->writable = writable;
+  p->type = PAGE_ZERO;
+  p->file = NULL;
+  p->file_ofs = 0;
+  p->read_bytes = 0;
+  p->frame = NULL;
+  p->zero_mapped = false;
+  p->swap_slot = SWAP_NONE;
+  if (hash_insert (t->pages, &p->hash_elem) != NULL) 
+    {
+      kmem_cache_free (page_cache, p);
+      return NULL;
+    }
+  return p;
+}
+
+/* Returns a hash value for page P_. */
+static unsigned
+page_hash (const struct hash_elem *p_, void *aux UNUSED) 
+{
+  const struct page *p = hash_entry (p_, struct page, hash_elem);
+  return hash_bytes (&p->upage, sizeof p->upage);
+}
+
+/* Returns true if page A precedes page B. */
+static bool
+page_less (const struct hash_elem *a_, const struct hash_elem *b_,
+           void *aux UNUSED) 
+{
+  const struct page *a = hash_entry (a_, struct page, hash_elem);
+  const struct page *b = hash_entry (b_, struct page, hash_elem);
+  return a->upage < b->upage;
+}
+
+/* Releases the frame or swap slot of page P_ and frees it,
+   writing it back to its file first if it is a modified page of
+   a mapped file.  Waits for the page to finish moving if another
+   thread is evicting it. */
+static void
+page_destroy (struct hash_elem *p_, void *aux UNUSED) 
+{
+  struct page *p = hash_entry (p_, struct page, hash_elem);
+
+  lock_acquire (&p->lock);
+  if (p->frame != NULL) 
+    frame_release (p->frame, p);
+  else if (p->zero_mapped)
+    pagedir_clear_page (p->pagedir, p->upage);
+  else if (p->swap_slot != SWAP_NONE)
+    swap_free (p->swap_slot);
+  lock_release (&p->lock);
+
+  kmem_cache_free (page_cache, p);
+}
@@ -0,0 +1,104 @@
+#ifndef VM_PAGE_H
+#define VM_PAGE_H
+
+#include <hash.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "filesys/off_t.h"
+#include "threads/synch.h"
+
+/* Supplemental page table.
+
+   Each process has a hash table, keyed by user virtual page,
+   that describes each page of its address space: where its
+   contents come from the first time it is touched, and where
+   they are now.  The page directory still records which pages
+   are present; a page that is in the supplemental page table but
+   not in the page directory is brought in by the page fault
+   handler.
+
+   A page that has been written to goes to swap when it is
+   evicted, and comes back from there.  A clean page is simply
+   dropped, and filled again from its original source.
+
+   A page of a memory-mapped file is never swapped: it shares a
+   frame with every other mapping of the same page of the file,
+   and is written back to the file when it is evicted or
+   unmapped.  A read-only page of an executable likewise shares
+   a frame with every other process running the same executable,
+   and is simply dropped when it is evicted.
+
+   A page that starts out as all zeros is mapped read-only to a
+   single frame of zeros shared by everyone, the zero page, until
+   it is first written, so that large arrays that are never
+   written take no memory.
+
+   The stack starts out as one page.  An access to an address
+   that is not in the page table, but just below the stack
+   pointer or above it, within the maximum stack size of the top
+   of user memory, grows the stack to include it.
+
+   Pages of files are shared, so a fault on one may find its
+   neighbors already in memory; they are mapped along with it.
+   When a process faults on pages of files in order, the pages
+   ahead of it are read in the background. */
+
+/* Where a page's initial contents come from. */
+enum page_type
+  {
+    PAGE_FILE,                  /* Read from a file, zero the rest. */
+    PAGE_ZERO,                  /* All zeros. */
+    PAGE_MMAP                   /* Mapped file, written back. */
+  };
+
+/* A page of a process's address space. */
+struct page
+  {
+    struct hash_elem hash_elem; /* Element in the page table. */
+    void *upage;                /* User virtual address. */
+    uint32_t *pagedir;          /* Owner's page directory. */
+    bool writable;              /* Writable by the process? */
+    enum page_type type;        /* Source of the initial contents. */
+
+    /* PAGE_FILE and PAGE_MMAP only. */
+    struct file *file;          /* File to read. */
+    off_t file_ofs;             /* Offset in FILE. */
+    size_t read_bytes;          /* Bytes to read; the rest are zero. */
+
+    /* Current location.  Protected by LOCK. */
+    struct lock lock;           /* Held while moving the page. */
+    struct frame *frame;        /* Frame, if present. */
+    bool zero_mapped;           /* Mapped to the zero page? */
+    struct list_elem frame_elem; /* Element in frame's list of pages. */
+    size_t swap_slot;           /* Swap slot, or SWAP_NONE. */
+  };
+
+/* Maximum stack size in pages, set by the -sl option. */
+extern size_t stack_page_limit;
+
+/* Report each process's page faults?  Set by the -pf option. */
+extern bool page_fault_report;
+
+void page_init (void);
+struct hash *page_table_create (void);
+void page_table_destroy (struct hash *);
+
+bool page_add_file (void *upage, struct file *, off_t ofs,
+                    size_t read_bytes, bool writable);
+bool page_add_zero (void *upage, bool writable);
+bool page_add_mmap (void *upage, struct file *, off_t ofs,
+                    size_t read_bytes);
+void page_remove (void *upage);
+struct page *page_lookup (void *upage);
+bool page_in (void *addr, bool write);
+bool page_pin (void *addr, bool write);
+void page_unpin (void *addr);
+
+bool page_try_lock (struct page *);
+void page_unlock (struct page *);
+bool page_out (struct page *);
+void page_print_stats (void);
+void page_print_process_stats (void);
+
+#endif /* vm/page.h */
@@ -0,0 +1,286 @@
+#include "vm/swap.h"
+#include <bitmap.h>
+#include <debug.h>
+#include <hash.h>
+#include <list.h>
+#include <lz.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/disk.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+
+/* Swap space.
+
+   The swap disk, hd1:1 (hdd), is divided into page-size "slots"
+   of SECTORS_PER_SLOT consecutive sectors, and a bitmap records
+   which slots are in use.  Slots are handed out next fit, so
+   that pages evicted one after another land next to each other
+   on disk.
+
+   In front of the disk sits the swap cache: a page that is
+   swapped out is compressed and, if it shrinks to at most
+   CACHE_PAGE_MAX bytes, kept in kernel memory instead of being
+   written to its slot.  Only when the cache holds CACHE_MAX
+   bytes are its oldest pages written to disk to make room.  A
+   page that comes back from the cache needs no disk access at
+   all.  Pages that do not compress well go to disk directly. */
+
+/* Number of sectors in a swap slot. */
+#define SECTORS_PER_SLOT (PGSIZE / DISK_SECTOR_SIZE)
+
+/* Most compressed bytes kept in the swap cache. */
+#define CACHE_MAX (256 * 1024)
+
+/* A compressed page in the swap cache. */
+struct cached_page
+  {
+    struct hash_elem hash_elem; /* Element in cache. */
+    struct list_elem list_elem; /* Element in cache_fifo. */
+    size_t slot;                /* Slot reserved for the page. */
+    size_t size;                /* Size of DATA in bytes. */
+    uint8_t data[];             /* Compressed contents. */
+  };
+
+/* Largest block that malloc() fits two of into a page.  A bigger
+   block takes a whole page and saves nothing over not
+   compressing at all. */
+#define CACHE_BLOCK_MAX 2040
+
+/* Largest compressed page kept in the swap cache. */
+#define CACHE_PAGE_MAX (CACHE_BLOCK_MAX - sizeof (struct cached_page))
+
+static struct disk *swap_disk;          /* Swap disk, or null. */
+static struct bitmap *swap_map;         /* Slots in use. */
+static size_t swap_cursor;              /* Next-fit cursor in SWAP_MAP. */
+static struct lock swap_lock;           /* Protects everything here. */
+
+/* Swap cache. */
+static struct hash cache;               /* Cached pages, by slot. */
+static struct list cache_fifo;          /* Cached pages, oldest first. */
+static size_t cache_bytes;              /* Compressed bytes in cache. */
+static struct lz_table lz_table;        /* Scratch for lz_compress(). */
+static uint8_t lz_buf[CACHE_PAGE_MAX];  /* Compressed page. */
+static uint8_t writeback_buf[PGSIZE];   /* Page being written back. */
+
+/* Statistics. */
+static long long out_cnt;               /* Pages swapped out. */
+static long long in_cnt;                /* Pages swapped in. */
+static long long cache_hit_cnt;         /* Pages swapped in from cache. */
+static long long cache_in_bytes;        /* Bytes compressed into cache. */
+static long long cache_out_bytes;       /* Compressed size of the same. */
+static long long writeback_cnt;         /* Cached pages written to disk. */
+static long long direct_cnt;            /* Pages written to disk directly. */
+
+static hash_hash_func cached_page_hash;
+static hash_less_func cached_page_less;
+static struct cached_page *cache_lookup (size_t slot);
+static void cache_remove (struct cached_page *);
+static void cache_writeback (void);
+static void write_slot (size_t slot, const void *kpage);
+
+/* Initializes swap space.  Without a swap disk, there is no swap
+   space, and swap_out() always fails. */
+void
+swap_init (void) 
+{
+  size_t slot_cnt = 0;
+
+  swap_disk = disk_get (1, 1);
+  if (swap_disk != NULL)
+    slot_cnt = disk_size (swap_disk) / SECTORS_PER_SLOT;
+  else
+    printf ("swap: hd1:1 (hdd) not present, swapping disabled\n");
+
+  swap_map = bitmap_create (slot_cnt);
+  if (swap_map == NULL)
+    PANIC ("swap bitmap creation failed--disk is too large");
+  if (!hash_init (&cache, cached_page_hash, cached_page_less, NULL))
+    PANIC ("swap cache creation failed");
+  list_init (&cache_fifo);
+  lock_init (&swap_lock);
+}
+
+/* Swaps out the page at KPAGE, to the swap cache if it
+   compresses well and otherwise to disk, and returns its slot,
+   or SWAP_NONE if swap space is full. */
+size_t
+swap_out (const void *kpage) 
+{
+  struct cached_page *cp = NULL;
+  size_t slot, size;
+
+  lock_acquire (&swap_lock);
+  slot = bitmap_scan_and_flip_next (swap_map, &swap_cursor, 1, false);
+  if (slot == BITMAP_ERROR)
+    {
+      lock_release (&swap_lock);
+      return SWAP_NONE;
+    }
+  out_cnt++;
+
+  size = lz_compress (kpage, PGSIZE, lz_buf, sizeof lz_buf, &lz_table);
+  if (size > 0)
+    {
+      while (cache_bytes + size > CACHE_MAX)
+        cache_writeback ();
+      cp = malloc (sizeof *cp + size);
+    }
+  if (cp != NULL)
+    {
+      cp->slot = slot;
+      cp->size = size;
+      memcpy (cp->data, lz_buf, size);
+      hash_insert (&cache, &cp->hash_elem);
+      list_push_back (&cache_fifo, &cp->list_elem);
+      cache_bytes += size;
+      cache_in_bytes += PGSIZE;
+      cache_out_bytes += size;
+      lock_release (&swap_lock);
+      return slot;
+    }
+  direct_cnt++;
+  lock_release (&swap_lock);
+
+  write_slot (slot, kpage);
+  return slot;
+}
+
+/* Reads swap slot SLOT into the page at KPAGE and frees the
+   slot. */
+void
+swap_in (size_t slot, void *kpage) 
+{
+  struct cached_page *cp;
+  size_t i;
+
+  ASSERT (slot != SWAP_NONE);
+
+  lock_acquire (&swap_lock);
+  in_cnt++;
+  cp = cache_lookup (slot);
+  if (cp != NULL)
+    {
+      if (!lz_decompress (cp->data, cp->size, kpage, PGSIZE))
+        PANIC ("swap cache corrupted");
+      cache_hit_cnt++;
+      lock_release (&swap_lock);
+      swap_free (slot);
+      return;
+    }
+  lock_release (&swap_lock);
+
+  for (i = 0; i < SECTORS_PER_SLOT; i++)
+    disk_read (swap_disk, slot * SECTORS_PER_SLOT + i,
+               (uint8_t *) kpage + i * DISK_SECTOR_SIZE);
+  swap_free (slot);
+}
+
+/* Frees swap slot SLOT without reading it. */
+void
+swap_free (size_t slot) 
+{
+  struct cached_page *cp;
+
+  ASSERT (slot != SWAP_NONE);
+
+  lock_acquire (&swap_lock);
+  ASSERT (bitmap_test (swap_map, slot));
+  cp = cache_lookup (slot);
+  if (cp != NULL)
+    cache_remove (cp);
+  bitmap_reset (swap_map, slot);
+  lock_release (&swap_lock);
+}
+
+/* Prints swap statistics. */
+void
+swap_print_stats (void) 
+{
+  printf ("Swap: %zu slots, %lld pages out, %lld pages in\n",
+          bitmap_size (swap_map), out_cnt, in_cnt);
+  printf ("Swap cache: %zu pages in %zu bytes, "
+          "%lld%% compressed size, %lld%% hit rate, "
+          "%lld written back, %lld written directly\n",
+          hash_size (&cache), cache_bytes,
+          cache_in_bytes > 0 ? cache_out_bytes * 100 / cache_in_bytes : 0,
+          in_cnt > 0 ? cache_hit_cnt * 100 / in_cnt : 0,
+          writeback_cnt, direct_cnt);
+}
+
+/* Returns the cached page for SLOT, or a null pointer if SLOT
+   is not in the swap cache.  SWAP_LOCK must be held. */
+static struct cached_page *
+cache_lookup (size_t slot)
+{
+  struct cached_page key;
+  struct hash_elem *e;
+
+  key.slot = slot;
+  e = hash_find (&cache, &key.hash_elem);
+  return e != NULL ? hash_entry (e, struct cached_page, hash_elem) : NULL;
+}
+
+/* Removes CP from the swap cache and frees it.  SWAP_LOCK must
+   be held. */
+static void
+cache_remove (struct cached_page *cp)
+{
+  hash_delete (&cache, &cp->hash_elem);
+  list_remove (&cp->list_elem);
+  cache_bytes -= cp->size;
+  free (cp);
+}
+
+/* Writes the oldest page in the swap cache to its slot on disk
+   and removes it from the cache.  SWAP_LOCK must be held, and
+   is held across the disk writes so that nobody can look for
+   the page between leaving the cache and reaching the disk.
+   That only happens once the cache is full. */
+static void
+cache_writeback (void)
+{
+  struct cached_page *cp;
+
+  ASSERT (!list_empty (&cache_fifo));
+
+  cp = list_entry (list_front (&cache_fifo), struct cached_page, list_elem);
+  if (!lz_decompress (cp->data, cp->size, writeback_buf, PGSIZE))
+    PANIC ("swap cache corrupted");
+  write_slot (cp->slot, writeback_buf);
+  cache_remove (cp);
+  writeback_cnt++;
+}
+
+/* Writes the page at KPAGE to swap slot SLOT on disk. */
+static void
+write_slot (size_t slot, const void *kpage)
+{
+  size_t i;
+
+  for (i = 0; i < SECTORS_PER_SLOT; i++)
+    disk_write (swap_disk, slot * SECTORS_PER_SLOT + i,
+                (const uint8_t *) kpage + i * DISK_SECTOR_SIZE);
+}
+
+/* Returns a hash value for cached page CP_. */
+static unsigned
+cached_page_hash (const struct hash_elem *cp_, void *aux UNUSED)
+{
+  const struct cached_page *cp
+    = hash_entry (cp_, struct cached_page, hash_elem);
+  return hash_int (cp->slot);
+}
+
+/* Returns true if cached page A precedes cached page B. */
+static bool
+cached_page_less (const struct hash_elem *a_, const struct hash_elem *b_,
+                  void *aux UNUSED)
+{
+  const struct cached_page *a
+    = hash_entry (a_, struct cached_page, hash_elem);
+  const struct cached_page *b
+    = hash_entry (b_, struct cached_page, hash_elem);
+  return a->slot < b->slot;
+}